@@ -0,0 +1,277 @@
+/*
+Timing of the heavier per frame work, printed over serial at 115200 baud.
+
+Each stage is run a number of times and averaged, `micros()` only counts in 4us steps on
+a 16MHz board so single runs aren't accurate. Cycles are the time scaled by the clock speed.
+*/
+
+#include <led_bars.h>
+#include <led_audio.h>
+#include <led_vm.h>
+
+#define LED_DATA_PIN 5
+#define LED_SEGMENTS 4
+#define LED_PER_SEGMENT 60
+
+#define RUNS 16
+
+segment segments[LED_SEGMENTS] = {
+  [0] = { .first_position = 239, .reverse = true },
+  [1] = { .first_position = 120, .reverse = false },
+  [2] = { .first_position = 0, .reverse = false },
+  [3] = { .first_position = 119, .reverse = true },
+};
+
+LED_Bars bars(LED_SEGMENTS, LED_PER_SEGMENT, LED_DATA_PIN, segments);
+LED_VM vm;
+
+// The `bouncer` pattern as a program, three sine waves per segment a third of a cycle apart
+const uint8_t bouncer_program[] PROGMEM = {
+  OP_SEGMENTS, OP_STORE, 0,
+  // Each segment, counting down
+  OP_PUSH8, 3, OP_STORE, 1,
+  // Each line, x is the segment and y in 1/256ths of a led follows a sine of time plus the line's offset
+  OP_LOAD, 0, OP_PUSH8, 1, OP_SUB,
+  OP_TIME, OP_PUSH16, 131, 0, OP_SCALE, OP_LOAD, 1, OP_PUSH8, 85, OP_MUL, OP_ADD,
+  OP_SIN, OP_LEDS, OP_PUSH8, 1, OP_SUB, OP_MUL,
+  OP_PUSH8, 125, OP_SUBPIXEL,
+  OP_LOOP, 1, (uint8_t)-28,
+  OP_LOOP, 0, (uint8_t)-35,
+  OP_END,
+};
+
+// Drops falling down a random segment, close to `falling_rain`
+const uint8_t rain_program[] PROGMEM = {
+  OP_PUSH8, 100, OP_RAND, OP_PUSH8, 10, OP_LT, OP_JZ, 5,
+  OP_SEGMENTS, OP_RAND, OP_PUSH8, 40, OP_SPAWN,
+  OP_PUSH8, 125, OP_MOVE,
+  OP_END,
+};
+
+void print_timing(const char* name, uint16_t size, unsigned long total) {
+  unsigned long average = total / RUNS;
+  Serial.print(name);
+  Serial.print(" ");
+  Serial.print(size);
+  Serial.print(": ");
+  Serial.print(average);
+  Serial.print("us ");
+  Serial.print(average * (F_CPU / 1000000));
+  Serial.println(" cycles");
+}
+
+void benchmark_fft() {
+  // On the stack so the buffers are only around while this runs, big enough for 128 samples
+  int16_t re[128];
+  int16_t im[128];
+  for (uint8_t bits = 4; bits <= 7; bits++) {
+    uint16_t n = 1 << bits;
+    unsigned long total = 0;
+    for (uint8_t run = 0; run < RUNS; run++) {
+      // A fresh signal every run, a transform of its own output would be mostly zeros
+      for (uint16_t i = 0; i < n; i++) {
+        re[i] = random(-16384, 16384);
+        im[i] = 0;
+      }
+      unsigned long start = micros();
+      fft_q15(re, im, bits);
+      total += micros() - start;
+    }
+    print_timing("fft", n, total);
+  }
+}
+
+// Drawing every led of the matrix, whole, dithered and split between two leds, timed per 100 leds
+void benchmark_leds() {
+  uint16_t n = LED_SEGMENTS * LED_PER_SEGMENT;
+  unsigned long total = 0;
+  for (uint8_t run = 0; run < RUNS; run++) {
+    unsigned long start = micros();
+    for (uint8_t x = 0; x < LED_SEGMENTS; x++) {
+      for (uint8_t y = 0; y < LED_PER_SEGMENT; y++) {
+        bars.set_led_color(x, y, 0xFF8000, 125);
+      }
+    }
+    total += micros() - start;
+  }
+  print_timing("set_led_color leds", 100, total * 100 / n);
+
+  bars.set_dither(true);
+  total = 0;
+  for (uint8_t run = 0; run < RUNS; run++) {
+    unsigned long start = micros();
+    for (uint8_t x = 0; x < LED_SEGMENTS; x++) {
+      for (uint8_t y = 0; y < LED_PER_SEGMENT; y++) {
+        bars.set_led_color(x, y, 0xFF8000, 125);
+      }
+    }
+    total += micros() - start;
+  }
+  bars.set_dither(false);
+  print_timing("set_led_color dithered leds", 100, total * 100 / n);
+
+  total = 0;
+  for (uint8_t run = 0; run < RUNS; run++) {
+    unsigned long start = micros();
+    for (uint8_t x = 0; x < LED_SEGMENTS; x++) {
+      for (uint8_t y = 0; y < LED_PER_SEGMENT - 1; y++) {
+        bars.set_led_color_subpixel(x, (y << 8) + 0x80, 0xFF8000, 125);
+      }
+    }
+    total += micros() - start;
+  }
+  print_timing("set_led_color_subpixel leds", 100, total * 100 / (n - LED_SEGMENTS));
+}
+
+/*
+A dim led drawn with dithering for 16 frames, its average level in each channel against the
+exact level, both in thousandths of a step. The two should be within about 1/16 of a step.
+*/
+void benchmark_dither() {
+  const uint32_t color = 0x0305C8;
+  const uint8_t bright = 55;
+  if (bars.set_dither(true) == false) {
+    Serial.println("dither: out of memory");
+    return;
+  }
+  uint16_t sums[3] = { 0, 0, 0 };
+  for (uint8_t frame = 0; frame < 16; frame++) {
+    bars.set_led_color(0, 0, color, bright);
+    uint32_t shown = bars.get_led_color(0, 0);
+    for (uint8_t c = 0; c < 3; c++) {
+      sums[c] += (uint8_t)(shown >> (16 - 8 * c));
+    }
+  }
+  bars.set_dither(false);
+
+  Serial.print("dither average/exact rgb:");
+  for (uint8_t c = 0; c < 3; c++) {
+    Serial.print(" ");
+    Serial.print(sums[c] * 1000UL / 16);
+    Serial.print("/");
+    Serial.print((uint8_t)(color >> (16 - 8 * c)) * (uint32_t)bright * 1000 / 256);
+  }
+  Serial.println();
+}
+
+// A frame of a native pattern against the same look as a program
+void benchmark_pattern(const char* name, void (LED_Bars::*pattern)()) {
+  unsigned long total = 0;
+  for (uint8_t run = 0; run < RUNS; run++) {
+    unsigned long start = micros();
+    (bars.*pattern)();
+    total += micros() - start;
+  }
+  print_timing(name, LED_SEGMENTS * LED_PER_SEGMENT, total);
+}
+
+void benchmark_programs() {
+  benchmark_pattern("bouncer leds", &LED_Bars::bouncer);
+  vm.load_P(bouncer_program, sizeof(bouncer_program));
+  benchmark_pattern("bouncer program leds", &LED_Bars::program);
+
+  benchmark_pattern("falling_rain leds", &LED_Bars::falling_rain);
+  vm.load_P(rain_program, sizeof(rain_program));
+  benchmark_pattern("rain program leds", &LED_Bars::program);
+}
+
+// Noise patterns, plasma is evaluated at a quarter of the leds and interpolated
+void benchmark_noise() {
+  benchmark_pattern("plasma leds", &LED_Bars::plasma);
+  benchmark_pattern("lava leds", &LED_Bars::lava);
+}
+
+// Frames of `fire` that step the heat simulation, steps only happen every 16ms
+void benchmark_fire() {
+  bars.set_color(&LED_Bars::heat);
+  unsigned long total = 0;
+  for (uint8_t run = 0; run < RUNS; run++) {
+    delay(16);
+    unsigned long start = micros();
+    bars.fire();
+    total += micros() - start;
+  }
+  print_timing("fire step leds", LED_SEGMENTS * LED_PER_SEGMENT, total);
+  benchmark_pattern("fire leds", &LED_Bars::fire);
+}
+
+// Snake moves scored by flood fill, on their own board so the timing covers only the moves
+snake* bench_snakes[1];
+uint32_t snake_area[LED_SEGMENTS * 2 * LIFE_WORDS(LED_PER_SEGMENT)];
+
+void benchmark_snakes() {
+  Snakes snakes(LED_SEGMENTS, LED_PER_SEGMENT, bench_snakes, 1);
+  snakes.attach(snake_area, 2 * LIFE_WORDS(LED_PER_SEGMENT));
+  bench_snakes[0] = snakes.create_snake();
+  if (bench_snakes[0] == NULL) {
+    Serial.println("snake moves: out of memory");
+    return;
+  }
+  unsigned long total = 0;
+  unsigned long worst = 0;
+  for (uint16_t run = 0; run < RUNS * 16; run++) {
+    unsigned long start = micros();
+    snakes.move_snake(0);
+    unsigned long time = micros() - start;
+    total += time;
+    worst = max(worst, time);
+  }
+  print_timing("snake moves", 1, total / 16);
+  Serial.print("snake worst move: ");
+  Serial.print(worst);
+  Serial.println("us");
+  snakes.remove_snake(0);
+}
+
+// Snakes that got stuck in 2000 moves on boards one, two and all segments wide
+void benchmark_snake_respawns() {
+  for (uint8_t width = 1; width <= LED_SEGMENTS; width *= 2) {
+    Snakes snakes(width, LED_PER_SEGMENT, bench_snakes, 1);
+    snakes.attach(snake_area, 2 * LIFE_WORDS(LED_PER_SEGMENT));
+    bench_snakes[0] = snakes.create_snake();
+    if (bench_snakes[0] == NULL) {
+      Serial.println("snake respawns: out of memory");
+      return;
+    }
+    for (uint16_t move = 0; move < 2000; move++) {
+      snakes.move_snake(0);
+    }
+    snakes.remove_snake(0);
+    Serial.print("snake respawns ");
+    Serial.print(width);
+    Serial.print(" wide: ");
+    Serial.println(snakes.respawns);
+  }
+}
+
+// A whole frame of `fill`, mostly sending it to the strip, build with -DLED_INDEXED to compare
+void benchmark_frame() {
+  bars.set_pattern(&LED_Bars::fill);
+  unsigned long total = 0;
+  for (uint8_t run = 0; run < RUNS; run++) {
+    unsigned long start = micros();
+    bars.render();
+    total += micros() - start;
+  }
+  print_timing("fill frame leds", LED_SEGMENTS * LED_PER_SEGMENT, total);
+}
+
+void setup() {
+  Serial.begin(115200);
+  bars.begin();
+  bars.set_program(&vm);
+}
+
+void loop() {
+  benchmark_fft();
+  benchmark_leds();
+  benchmark_dither();
+  benchmark_programs();
+  benchmark_snakes();
+  benchmark_snake_respawns();
+  benchmark_noise();
+  benchmark_fire();
+  benchmark_frame();
+  Serial.println();
+  delay(5000);
+}
@@ -0,0 +1,80 @@
+/*
+Example of tuning color calibration for strips from different batches. Shows the
+`calibration_card` pattern on every segment, here the first two segments were cut from one
+batch and the last two from another.
+
+Take one batch as the reference and leave it straight. Change the gains of the other batch
+until its whites look the same, then its gammas until its grey steps do. Upload, paste the
+curves printed on the serial monitor into curves.h and upload again to see them applied.
+The sketch also checks curves.h against the gains and gammas and says when it's out of date.
+*/
+
+#include <led_bars.h>
+#include "curves.h"
+
+#define LED_DATA_PIN 5
+#define LED_SEGMENTS 4
+#define LED_PER_SEGMENT 60
+
+segment segments[LED_SEGMENTS] = {
+  [0] = { .first_position = 239, .reverse = true },
+  [1] = { .first_position = 120, .reverse = false },
+  [2] = { .first_position = 0, .reverse = false },
+  [3] = { .first_position = 119, .reverse = true },
+};
+
+LED_Bars bars(LED_SEGMENTS, LED_PER_SEGMENT, LED_DATA_PIN, segments);
+
+// Green, red and blue of each batch, the order of the bytes a led is sent as
+const float batch_gains[2][3] = { { 1.0, 1.0, 1.0 }, { 0.85, 1.0, 0.9 } };
+const float batch_gammas[2][3] = { { 1.0, 1.0, 1.0 }, { 1.1, 1.0, 1.1 } };
+
+led_calibration calibrations[LED_SEGMENTS] = {
+  [0] = { { batch_a_green, batch_a_red, batch_a_blue } },
+  [1] = { { batch_a_green, batch_a_red, batch_a_blue } },
+  [2] = { { batch_b_green, batch_b_red, batch_b_blue } },
+  [3] = { { batch_b_green, batch_b_red, batch_b_blue } },
+};
+
+// Is a curve in curves.h still the one its gain and gamma print
+bool curve_matches(const uint8_t* curve, float gain, float gamma) {
+  for (uint16_t i = 0; i < 256; i++) {
+    if (pgm_read_byte(&curve[i]) != calibration_value(i, gain, gamma)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void setup() {
+  Serial.begin(115200);
+  const char* names[2][3] = {
+    { "batch_a_green", "batch_a_red", "batch_a_blue" },
+    { "batch_b_green", "batch_b_red", "batch_b_blue" },
+  };
+  Serial.println("// Printed by calibration.ino for the gains and gammas at the top of the sketch");
+  Serial.println();
+  for (uint8_t batch = 0; batch < 2; batch++) {
+    for (uint8_t channel = 0; channel < 3; channel++) {
+      print_calibration(Serial, names[batch][channel], batch_gains[batch][channel], batch_gammas[batch][channel]);
+    }
+  }
+
+  // Batches start at every second segment
+  bool matches = true;
+  for (uint8_t batch = 0; batch < 2; batch++) {
+    for (uint8_t channel = 0; channel < 3; channel++) {
+      const uint8_t* curve = calibrations[batch * 2].curves[channel];
+      matches &= curve_matches(curve, batch_gains[batch][channel], batch_gammas[batch][channel]);
+    }
+  }
+  Serial.println(matches ? "// curves.h matches these curves" : "// curves.h is out of date, paste the curves above");
+
+  bars.begin();
+  bars.set_calibration(calibrations);
+  bars.set_pattern(&bars.calibration_card);
+}
+
+void loop() {
+  bars.render();
+}
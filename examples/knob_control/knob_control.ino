@@ -1,15 +1,15 @@
 /*
 Example for software controls for a set of led bars attached to a rotary encoder.
-Intended to be used with a Arduino Pro or Pro-Mini and requires the `Encoder` library.
+Intended to be used with a Arduino Pro or Pro-Mini.
 
-The inputs expect a rotary encoder with its two channels connected to external interrupts
-and an external input that will be polled for button presses. By default this uses digital pins
-2, 3 and 4 respectivley. The output needs to be a PWM compatiblke digital pin, by default this is 
+The inputs expect a rotary encoder with its two channels and push button connected to digital pins
+2, 3 and 4 respectivley. All three are read through pin change interrupts so input is handled
+independently of how long a frame takes. The output needs to be a PWM compatiblke digital pin, by default this is 
 digital pin 5. Connect this pin, along with power and ground, to the led strip input.
 
 Usage:
 - Press the rotary encoder to transition states in this order:
-  - off
+  - off, the board sleeps until the encoder is turned or pressed
   - on
   - color select
   - pattern select
@@ -18,7 +18,7 @@ Usage:
 */
 
 #include <led_bars.h>
-#include <Encoder.h>
+#include <led_input.h>
 
 #ifdef __AVR__
  #include <avr/power.h>
@@ -47,7 +47,20 @@ segment segments[LED_SEGMENTS] = {
 
 LED_Bars bars(LED_SEGMENTS, LED_PER_SEGMENT, LED_DATA_PIN, segments);
 
-Encoder knob(RE_CHAN1_PIN, RE_CHAN2_PIN);
+LED_Input input;
+// The pin change handlers that feed the input, and wake the board from sleep
+LED_INPUT_ISR()
+
+// What turning the dial does in each select mode
+const input_binding color_bindings[] = {
+  { INPUT_ROTATE_CW, &LED_Bars::next_color },
+  { INPUT_ROTATE_CCW, &LED_Bars::prev_color },
+};
+
+const input_binding pattern_bindings[] = {
+  { INPUT_ROTATE_CW, &LED_Bars::next_pattern },
+  { INPUT_ROTATE_CCW, &LED_Bars::prev_pattern },
+};
 
 enum op_states
 {
@@ -58,38 +71,20 @@ enum op_states
 };
 op_states current_state = on;
 
-long prev_knob_position  = 0;
-int button_state = HIGH;
-int prev_button_state = HIGH;
-
-uint32_t last_debounce_time = 0;
-uint32_t debounce_delay = 50;
-
 uint32_t last_edit_time = millis();
 
-void handle_clockwise() {
+// Move between the on, off and editing states and swap in the dial bindings for the new state
+void set_mode(op_states state) {
+  current_state = state;
   switch (current_state) {
     case color_select:
-      bars.next_color();
+      input.set_bindings(color_bindings, 2);
       break;
     case pattern_select:
-      bars.next_pattern();
+      input.set_bindings(pattern_bindings, 2);
       break;
     default:
-      ;
-  }
-}
-
-void handle_counterclockwise() {
-  switch (current_state) {
-    case color_select:
-      bars.prev_color();
-      break;
-    case pattern_select:
-      bars.prev_pattern();
-      break;
-    default:
-      ;
+      input.set_bindings(NULL, 0);
   }
 }
 
@@ -97,79 +92,51 @@ void handle_counterclockwise() {
 void next_mode() {
   switch (current_state) {
     case color_select:
-      current_state = pattern_select;
+      set_mode(pattern_select);
       break;
     case pattern_select:
-      current_state = off;
+      // Selection is done, the library writes it to EEPROM in the background
+      bars.save_values();
+      set_mode(off);
       break;
     case off:
-      current_state = on;
+      set_mode(on);
       break;
     case on:
-      current_state = color_select;
+      last_edit_time = millis();
+      set_mode(color_select);
       break;
     default:
       ;
   }
 }
 
-void handle_knob_changes() {
-  long knob_position = knob.read();
-  // The rotary encoder tracks the number of button state changes
-  // in a dial turn. This means the two channels will switch from off to on to off
-  // making for 4 state changes in a single turn
-  if (knob_position % 4 == 0) {
-    if (knob_position > prev_knob_position) {
-      last_edit_time = millis();
-      handle_clockwise();
-    }
-    if (knob_position < prev_knob_position) {
-      last_edit_time = millis();
-      handle_counterclockwise();
-    }
-    prev_knob_position = knob_position;
-  }
-}
-
-void handle_button_press() {
-  int button_reading = digitalRead(RE_BUTTON_PIN);
-  if (button_reading != prev_button_state) {
-    last_debounce_time = millis();
-  }
-
-  // Software check for button debounce
-  if ((millis() - last_debounce_time) > debounce_delay) {
-    if (button_reading != button_state) {
-      button_state = button_reading;
-      if (button_state == HIGH) {
-        next_mode();
-      }
-    }
-  }
-  prev_button_state = button_reading;
-}
-
 void setup() {
-  pinMode(RE_BUTTON_PIN, INPUT);
+  input.begin(RE_CHAN1_PIN, RE_CHAN2_PIN, RE_BUTTON_PIN);
   bars.begin();
 } 
 
 void loop() {
-  // The Encoder library uses both external interrupts on a Pro/Mini so we
-  // must poll for a direct button press first.
-  handle_button_press();
+  // Apply everything that happened since the last frame, the dial is already
+  // bound to the controls for the current state
+  uint8_t events = input.dispatch(bars);
+  if (events & (INPUT_MASK(INPUT_ROTATE_CW) | INPUT_MASK(INPUT_ROTATE_CCW))) {
+    last_edit_time = millis();
+  }
+  if (events & (INPUT_MASK(INPUT_PRESS) | INPUT_MASK(INPUT_LONG_PRESS))) {
+    next_mode();
+  }
+
   if (current_state == off) {
-    bars.off();
+    // Blank the strip and sleep until the dial or button wakes us, nothing needs to restart after
+    bars.sleep(&input);
   }
   else {
-    if (current_state != on) {
-      handle_knob_changes();
-
-      // If nothing has changed for a bit then break out
-      // of the edit state
-      if (millis() - last_edit_time > 10000 ) {
-        current_state = on;
-      }
+    // If nothing has changed for a bit then break out
+    // of the edit state
+    if (current_state != on && millis() - last_edit_time > 10000 ) {
+      bars.save_values();
+      set_mode(on);
     }
     bars.render();
   }
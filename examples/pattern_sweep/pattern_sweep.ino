@@ -0,0 +1,105 @@
+/*
+Renders every pattern and color combination on a simulated clock and streams the frames over
+serial as PPM images, one image per combination with a row per sampled frame and a column per
+led in segment order. Save the serial output and split it on "P6" to review a change to the
+patterns or colors without watching the strip.
+
+The pattern is restarted with the same seed and simulated clock for every combination, so each
+run renders the same frames and nothing is left over from the combination before it.
+After each image a text line gives the real render time of the combination:
+
+  # pattern color average_us worst_us
+*/
+
+#include <led_bars.h>
+
+#define LED_DATA_PIN 5
+#define LED_SEGMENTS 4
+#define LED_PER_SEGMENT 60
+
+// Simulated time between frames and the frames rendered for each combination
+#define FRAME_MS 33
+#define FRAMES 120
+// Every nth frame becomes a row of the image
+#define SAMPLE_EVERY 5
+
+segment segments[LED_SEGMENTS] = {
+  [0] = { .first_position = 239, .reverse = true },
+  [1] = { .first_position = 120, .reverse = false },
+  [2] = { .first_position = 0, .reverse = false },
+  [3] = { .first_position = 119, .reverse = true },
+};
+
+LED_Bars bars(LED_SEGMENTS, LED_PER_SEGMENT, LED_DATA_PIN, segments);
+
+unsigned long sim_time = 0;
+
+unsigned long sim_clock() {
+  return sim_time;
+}
+
+void write_row() {
+  for (uint8_t x = 0; x < LED_SEGMENTS; x++) {
+    for (uint8_t y = 0; y < LED_PER_SEGMENT; y++) {
+      uint32_t value = bars.get_led_color(x, y);
+      Serial.write((uint8_t)(value >> 16));
+      Serial.write((uint8_t)(value >> 8));
+      Serial.write((uint8_t)value);
+    }
+  }
+}
+
+void sweep(uint8_t pattern, uint8_t color) {
+  bars.set_pattern_index(pattern);
+  bars.set_color_index(color);
+  // Start far enough in that patterns timing against the last frame behave normally
+  sim_time = 60000;
+  bars.seed(1);
+  // Particles, timers and boards from the last combination would change the frames
+  bars.restart_pattern();
+
+  Serial.print("P6\n");
+  Serial.print(LED_SEGMENTS * LED_PER_SEGMENT);
+  Serial.print(" ");
+  Serial.print(FRAMES / SAMPLE_EVERY);
+  Serial.print("\n255\n");
+
+  unsigned long total = 0;
+  unsigned long worst = 0;
+  for (uint16_t frame = 0; frame < FRAMES; frame++) {
+    unsigned long start = micros();
+    bars.render();
+    unsigned long elapsed = micros() - start;
+    total += elapsed;
+    worst = max(worst, elapsed);
+    if (frame % SAMPLE_EVERY == 0) {
+      write_row();
+    }
+    sim_time += FRAME_MS;
+  }
+
+  Serial.print("# ");
+  Serial.print(pattern);
+  Serial.print(" ");
+  Serial.print(color);
+  Serial.print(" ");
+  Serial.print(total / FRAMES);
+  Serial.print(" ");
+  Serial.println(worst);
+}
+
+void setup() {
+  Serial.begin(1000000);
+  bars.begin();
+  set_led_clock(sim_clock);
+}
+
+void loop() {
+  for (uint8_t pattern = 0; pattern < bars.get_num_patterns(); pattern++) {
+    for (uint8_t color = 0; color < bars.get_num_colors(); color++) {
+      sweep(pattern, color);
+    }
+  }
+  while (true) {
+  }
+}
@@ -30,6 +30,8 @@ uint32_t color_time = millis();
 
 void setup() {
   bars.begin();
+  // Crossfade into each new pattern over a second, patterns cut instead if there isn't the RAM for it
+  bars.set_transition(1000);
 }
 
 void loop() {
@@ -0,0 +1,46 @@
+/*
+Example of showing frames streamed from a computer using the Adalight protocol, as sent by
+Prismatik, Hyperion and similar tools. Frames are sent segment by segment starting from the
+first led of each segment, set the led count in the sending tool to LED_SEGMENTS * LED_PER_SEGMENT.
+Anything that can be sent over a `Stream` works, here it's the USB serial port.
+
+Bytes that arrive while a frame is being shown are lost, interrupts are off for about 7.2ms
+for 240 leds. Limit the sending tool to about 45 frames a second at 500000 baud so there's a
+gap for it between frames, see the README.
+*/
+
+#include <led_bars.h>
+
+#define LED_DATA_PIN 5
+#define LED_SEGMENTS 4
+#define LED_PER_SEGMENT 60
+
+segment segments[LED_SEGMENTS] = {
+  [0] = { .first_position = 239, .reverse = true },
+  [1] = { .first_position = 120, .reverse = false },
+  [2] = { .first_position = 0, .reverse = false },
+  [3] = { .first_position = 119, .reverse = true },
+};
+
+LED_Bars bars(LED_SEGMENTS, LED_PER_SEGMENT, LED_DATA_PIN, segments);
+
+uint32_t handshake_time = millis();
+
+void setup() {
+  // A full 240 led frame is 726 bytes, fast baud rates are needed for a good frame rate
+  Serial.begin(500000);
+  // The same "Ada" handshake Adalight sketches send so hosts detect the device
+  Serial.print("Ada\n");
+  bars.begin();
+  bars.set_frame_source(&Serial);
+  bars.set_pattern(&bars.external_frames);
+}
+
+void loop() {
+  bars.render();
+  // Keep the host happy between frames, Adalight hosts use this as a keep alive
+  if ((millis() - handshake_time) > 1000) {
+    Serial.print("Ada\n");
+    handshake_time = millis();
+  }
+}
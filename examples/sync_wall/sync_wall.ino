@@ -0,0 +1,51 @@
+/*
+Example of several controllers showing one animation across a wall of bars.
+
+The leader cycles patterns and colors like the simple cycle example and broadcasts its state
+from its serial transmit pin, wire it to the receive pin of every follower along with a shared
+ground. Build one board with LEADER defined and the rest without.
+*/
+
+#include <led_bars.h>
+#include <led_sync.h>
+
+#define LEADER
+
+#define LED_DATA_PIN 5
+#define LED_SEGMENTS 4
+#define LED_PER_SEGMENT 60
+
+segment segments[LED_SEGMENTS] = {
+  [0] = { .first_position = 239, .reverse = true },
+  [1] = { .first_position = 120, .reverse = false },
+  [2] = { .first_position = 0, .reverse = false },
+  [3] = { .first_position = 119, .reverse = true },
+};
+
+LED_Bars bars(LED_SEGMENTS, LED_PER_SEGMENT, LED_DATA_PIN, segments);
+LED_Sync sync(Serial);
+
+uint32_t pattern_time = millis();
+uint32_t color_time = millis();
+
+void setup() {
+  Serial.begin(115200);
+  bars.begin();
+}
+
+void loop() {
+#ifdef LEADER
+  if ((millis() - color_time) > 1000) {
+    bars.next_color();
+    color_time = millis();
+  }
+  if ((millis() - pattern_time) > 5000) {
+    bars.next_pattern();
+    pattern_time = millis();
+  }
+  sync.lead(bars);
+#else
+  sync.follow(bars);
+#endif
+  bars.render();
+}
@@ -23,7 +23,8 @@ segment segments[LED_SEGMENTS] = {
   [3] = { .first_position = 119, .reverse = true },
 };
 
-LED_Bars bars(LED_SEGMENTS, LED_PER_SEGMENT, LED_DATA_PIN, segments);
+// Geometry is fixed at compile time so buffers are sized exactly and no build flags are needed
+LED_Matrix<LED_SEGMENTS, LED_PER_SEGMENT> bars(LED_DATA_PIN, segments);
 
 void setup() {
   bars.begin();
@@ -0,0 +1,244 @@
+#include "Arduino.h"
+#include "led_audio.h"
+
+// The ADC interrupt needs a fixed target, only one audio input can be active
+static LED_Audio* active_audio = NULL;
+
+// First quarter of a sine wave over 256 steps, enough for every twiddle factor up to 256 samples
+static const int16_t sine_table[65] PROGMEM = {
+  0, 804, 1608, 2411, 3212, 4011, 4808, 5602,
+  6393, 7180, 7962, 8740, 9512, 10279, 11039, 11793,
+  12540, 13279, 14010, 14733, 15447, 16151, 16846, 17531,
+  18205, 18868, 19520, 20160, 20788, 21403, 22006, 22595,
+  23170, 23732, 24279, 24812, 25330, 25833, 26320, 26791,
+  27246, 27684, 28106, 28511, 28899, 29269, 29622, 29957,
+  30274, 30572, 30853, 31114, 31357, 31581, 31786, 31972,
+  32138, 32286, 32413, 32522, 32610, 32679, 32729, 32758,
+  32767,
+};
+
+// Sine and cosine for the first half of the table's circle, all the FFT needs
+static int16_t sin_q15(uint8_t index) {
+  return pgm_read_word(&sine_table[index <= 64 ? index : 128 - index]);
+}
+
+static int16_t cos_q15(uint8_t index) {
+  if (index <= 64) {
+    return pgm_read_word(&sine_table[64 - index]);
+  }
+  return -pgm_read_word(&sine_table[index - 64]);
+}
+
+void fft_q15(int16_t* re, int16_t* im, uint8_t bits) {
+  uint16_t n = 1 << bits;
+
+  // Reorder into bit reversed index order so the butterflies can work in place
+  for (uint16_t i = 1, j = 0; i < n; i++) {
+    uint16_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      int16_t temp = re[i];
+      re[i] = re[j];
+      re[j] = temp;
+      temp = im[i];
+      im[i] = im[j];
+      im[j] = temp;
+    }
+  }
+
+  for (uint16_t len = 1; len < n; len <<= 1) {
+    // Twiddle angles are pi * k / len, half the table spans pi
+    uint8_t step = (1 << (LED_AUDIO_MAX_BITS - 1)) / len;
+    for (uint16_t k = 0; k < len; k++) {
+      int16_t wr = cos_q15(k * step);
+      int16_t wi = -sin_q15(k * step);
+      for (uint16_t i = k; i < n; i += len << 1) {
+        uint16_t j = i + len;
+        // Products are Q30, shifting by 16 leaves them halved in Q15
+        int16_t tr = ((int32_t)wr * re[j] - (int32_t)wi * im[j]) >> 16;
+        int16_t ti = ((int32_t)wr * im[j] + (int32_t)wi * re[j]) >> 16;
+        int16_t qr = re[i] >> 1;
+        int16_t qi = im[i] >> 1;
+        re[j] = qr - tr;
+        im[j] = qi - ti;
+        re[i] = qr + tr;
+        im[i] = qi + ti;
+      }
+    }
+  }
+}
+
+void led_audio_sample(int16_t value) {
+  if (active_audio != NULL) {
+    active_audio->sample(value);
+  }
+}
+
+#ifdef __AVR__
+// Overridden by the definition in `LED_AUDIO_ISR()` when the sketch has the handler
+bool led_audio_interrupts __attribute__((weak)) = false;
+#endif
+
+// Is the window filled by the ADC interrupt rather than read in `update()`
+static bool using_interrupt() {
+#ifdef __AVR__
+  return led_audio_interrupts;
+#else
+  return false;
+#endif
+}
+
+/*
+Start sampling an analog pin.
+
+@param analog_pin Pin the audio signal is connected to, such as A0
+*/
+void LED_Audio::begin(uint8_t analog_pin) {
+  pin = analog_pin;
+  for (uint8_t i = 0; i < LED_AUDIO_BANDS; i++) {
+    peaks[i] = LED_AUDIO_FLOOR;
+    bands[i] = 0;
+  }
+  active_audio = this;
+
+#ifdef __AVR__
+  // Without a handler the ADC is left to `analogRead()`
+  if (led_audio_interrupts == false) {
+    start_window();
+    return;
+  }
+  uint8_t channel = pin >= A0 ? pin - A0 : pin;
+  noInterrupts();
+  // AVcc reference, free running with a /128 clock, 13 cycles a conversion is about 9.6kHz at 16MHz
+  ADMUX = bit(REFS0) | (channel & 0x07);
+  ADCSRB = 0;
+  DIDR0 |= bit(channel & 0x07);
+  ADCSRA = bit(ADEN) | bit(ADATE) | bit(ADPS2) | bit(ADPS1) | bit(ADPS0) | bit(ADSC);
+  interrupts();
+#endif
+  start_window();
+}
+
+void LED_Audio::start_window() {
+  sample_count = 0;
+#ifdef __AVR__
+  if (led_audio_interrupts == true) {
+    ADCSRA |= bit(ADIE);
+  }
+#endif
+}
+
+// Store a raw 10 bit reading, centred and scaled up to use most of the Q15 range
+void LED_Audio::sample(int16_t value) {
+  if (sample_count >= LED_AUDIO_SAMPLES) {
+    return;
+  }
+  samples[sample_count] = (value - 512) * 32;
+  if (++sample_count == LED_AUDIO_SAMPLES) {
+#ifdef __AVR__
+    if (using_interrupt() == true) {
+      ADCSRA &= ~bit(ADIE);
+    }
+#endif
+  }
+}
+
+/*
+Analyse the last window if it's full and start the next one.
+
+Should be called once a frame, `render()` does this for an `LED_Bars` with audio set.
+Without the ADC interrupt this is also where the next few samples are read.
+
+@return True when new band levels are available
+*/
+bool LED_Audio::update() {
+  beat = false;
+  if (using_interrupt() == false) {
+    for (uint8_t i = 0; i < LED_AUDIO_POLL && sample_count < LED_AUDIO_SAMPLES; i++) {
+      sample(analogRead(pin));
+    }
+  }
+  if (sample_count < LED_AUDIO_SAMPLES) {
+    return false;
+  }
+  analyse();
+  start_window();
+  return true;
+}
+
+void LED_Audio::analyse() {
+  // Sampling is stopped while the window is full so the FFT can work on it in place
+  int16_t* re = (int16_t*)samples;
+  int16_t im[LED_AUDIO_SAMPLES];
+
+  // Remove any DC offset, the bias is rarely exactly half the supply
+  int32_t sum = 0;
+  for (uint16_t i = 0; i < LED_AUDIO_SAMPLES; i++) {
+    sum += re[i];
+  }
+  int16_t mean = sum >> LED_AUDIO_BITS;
+
+  /*
+  Hann window, sin^2 of pi * i / samples. Without it a tone between two bins leaks
+  into every band and the automatic gain scales that leakage up to full brightness.
+  */
+  for (uint16_t i = 0; i < LED_AUDIO_SAMPLES; i++) {
+    int16_t s = sin_q15((i << (LED_AUDIO_MAX_BITS - 1)) >> LED_AUDIO_BITS);
+    int16_t window = ((int32_t)s * s) >> 15;
+    re[i] = ((int32_t)(re[i] - mean) * window) >> 15;
+    im[i] = 0;
+  }
+
+  fft_q15(re, im, LED_AUDIO_BITS);
+
+  // Octave bands, band `b` holds bins `2^b` up to `2^(b+1)`
+  uint16_t energy[LED_AUDIO_BANDS];
+  uint32_t band_energy = 0;
+  uint8_t band = 0;
+  for (uint16_t k = 1; k < LED_AUDIO_SAMPLES / 2; k++) {
+    if (k == (2 << band)) {
+      energy[band++] = min(band_energy, (uint32_t)0xFFFF);
+      band_energy = 0;
+    }
+    // Magnitude approximated as the larger part plus 3/8 of the smaller one, within about 7%
+    uint16_t a = abs(re[k]);
+    uint16_t b = abs(im[k]);
+    band_energy += a > b ? a + (b >> 2) + (b >> 3) : b + (a >> 2) + (a >> 3);
+  }
+  energy[band] = min(band_energy, (uint32_t)0xFFFF);
+
+  level = 0;
+  for (uint8_t i = 0; i < LED_AUDIO_BANDS; i++) {
+    // Peaks decay by about half every 180 windows, a little over a second
+    peaks[i] = max((uint16_t)(peaks[i] - (peaks[i] >> 8)), (uint16_t)LED_AUDIO_FLOOR);
+    if (energy[i] > peaks[i]) {
+      peaks[i] = energy[i];
+    }
+    bands[i] = (uint32_t)energy[i] * 255 / peaks[i];
+    level = max(level, bands[i]);
+  }
+
+  // A beat is bass energy well above its recent average
+  uint16_t bass_energy = min((uint32_t)energy[0] + energy[1], (uint32_t)0xFFFF);
+  if (bass_energy > LED_AUDIO_FLOOR && bass_energy > bass_average + (bass_average >> 1)
+      && millis() - last_beat > LED_AUDIO_BEAT_GAP) {
+    beat = true;
+    last_beat = millis();
+    beats++;
+  }
+  bass_average += ((int32_t)bass_energy - bass_average) / 8;
+  windows++;
+}
+
+// Level of the lowest two bands
+uint8_t LED_Audio::bass() {
+  return max(bands[0], bands[1]);
+}
+
+// Level of the highest two bands
+uint8_t LED_Audio::treble() {
+  return max(bands[LED_AUDIO_BANDS - 1], bands[LED_AUDIO_BANDS - 2]);
+}
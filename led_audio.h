@@ -0,0 +1,119 @@
+/*
+Audio analysis for driving patterns from sound.
+
+A microphone or line level signal, biased to half the supply, is sampled from an analog pin
+into a fixed window. Each full window runs through a fixed point radix-2 FFT and the bins are
+summed into octave wide bands, the lowest bands also feed a simple beat detector. Band values
+are scaled against a slowly decaying peak so quiet and loud rooms both use the full range.
+
+On AVR the ADC free runs at about 9.6kHz and fills the window from its interrupt, so sampling
+costs nothing while a frame renders and `analogRead()` must not be used while audio is running.
+The interrupt handler is only defined by sketches that expand `LED_AUDIO_ISR()` once at file
+scope, so the library never takes the ADC vector from sketches that don't use audio. A sketch
+that already owns it defines `bool led_audio_interrupts = true;` and calls
+`led_audio_sample(ADC)` from its handler. Without either, and on other boards, each `update()`
+reads `LED_AUDIO_POLL` samples with `analogRead()` so no single frame stalls for a whole
+window. The window is then stitched together from bursts taken a frame apart, which smears
+the higher bands, so use the interrupt where the bands matter.
+
+  LED_Audio audio;
+  LED_AUDIO_ISR()
+*/
+
+#ifndef led_audio_h
+#define led_audio_h
+
+#include "Arduino.h"
+
+// Samples per window as a power of two, the window needs 2 bytes per sample
+#ifndef LED_AUDIO_BITS
+#define LED_AUDIO_BITS 6
+#endif
+
+// Largest window `fft_q15()` supports, sets the size of the sine table
+#define LED_AUDIO_MAX_BITS 8
+
+#if LED_AUDIO_BITS < 3 || LED_AUDIO_BITS > LED_AUDIO_MAX_BITS
+#error "LED_AUDIO_BITS must be between 3 and 8"
+#endif
+
+#define LED_AUDIO_SAMPLES (1 << LED_AUDIO_BITS)
+
+// One band per octave of bins, from the first bin above DC to the last below nyquist
+#define LED_AUDIO_BANDS (LED_AUDIO_BITS - 1)
+
+// Samples read per `update()` without the ADC interrupt, an `analogRead()` takes about 112us on AVR
+#ifndef LED_AUDIO_POLL
+#define LED_AUDIO_POLL 8
+#endif
+
+// Band energy below this is treated as silence and not scaled up
+#ifndef LED_AUDIO_FLOOR
+#define LED_AUDIO_FLOOR 256
+#endif
+
+// Shortest time between beats, in ms
+#ifndef LED_AUDIO_BEAT_GAP
+#define LED_AUDIO_BEAT_GAP 150
+#endif
+
+/*
+In place fixed point FFT of `1 << bits` samples.
+
+Values are Q15 and every stage halves its output so the result never overflows,
+each bin ends up as the true value divided by the number of samples.
+*/
+void fft_q15(int16_t* re, int16_t* im, uint8_t bits);
+
+class LED_Audio {
+
+private:
+  volatile int16_t samples[LED_AUDIO_SAMPLES];
+  volatile uint8_t sample_count = LED_AUDIO_SAMPLES;
+  uint8_t pin;
+
+  // Band energy tracking for automatic gain and beats
+  uint16_t peaks[LED_AUDIO_BANDS];
+  uint16_t bass_average = 0;
+
+  void start_window();
+  void analyse();
+
+public:
+  // Band levels from lowest to highest frequency, 0-255
+  uint8_t bands[LED_AUDIO_BANDS];
+  // Loudest band
+  uint8_t level = 0;
+  // True for the frame a beat was detected in
+  bool beat = false;
+  unsigned long last_beat = 0;
+  uint16_t beats = 0;
+  // Windows analysed, useful for checking the sample rate
+  unsigned long windows = 0;
+
+  void begin(uint8_t analog_pin);
+  bool update();
+  uint8_t bass();
+  uint8_t treble();
+
+  // Called from the ADC interrupt
+  void sample(int16_t value);
+};
+
+// Hand a reading to the audio input that was started last, for the ADC handler
+void led_audio_sample(int16_t value);
+
+#ifdef __AVR__
+// True once the sketch handles the ADC interrupt, see `LED_AUDIO_ISR()`
+extern bool led_audio_interrupts;
+
+#define LED_AUDIO_ISR() \
+  bool led_audio_interrupts = true; \
+  ISR(ADC_vect) { \
+    led_audio_sample(ADC); \
+  }
+#else
+#define LED_AUDIO_ISR()
+#endif
+
+#endif
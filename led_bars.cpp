@@ -1,8 +1,60 @@
 #include "Arduino.h"
 #include "led_bars.h"
+#include "led_input.h"
+#include "led_noise.h"
+#include "led_send.h"
 #include "math.h"
 #include "Adafruit_NeoPixel.h"
-#include <EEPROM.h>
+
+
+/*
+Storage for a plain `LED_Bars`, sized by the `LED_SEGMENTS` and `LED_PER_SEGMENT` build flags.
+
+Only referenced by the constructor below so it is dropped at link time from sketches
+that use `LED_Matrix` instead.
+*/
+static segment default_segments[LED_SEGMENTS];
+static particle default_particles[LED_SEGMENTS][LED_PARTICLES];
+static zone default_zones[LED_ZONES];
+static snake* default_snakes[LED_ZONES];
+
+static led_storage default_storage() {
+  led_storage store = {
+    default_segments, default_particles, default_zones, LED_ZONES, default_snakes,
+  };
+  return store;
+}
+
+// Longest segment `led_coord_t` can address
+static const uint32_t max_led_per_segment = (uint32_t)(led_coord_t)~0 + 1;
+
+LED_Bars::LED_Bars(uint16_t n_segs, uint16_t led_per_seg, uint16_t data_pin, segment* segs)
+  : LED_Bars(
+    min(n_segs, (uint16_t)LED_SEGMENTS), min((uint32_t)led_per_seg, max_led_per_segment),
+    data_pin, segs, default_storage()
+  ) {
+  geometry_fits = n_segs <= LED_SEGMENTS && led_per_seg <= max_led_per_segment;
+};
+
+
+// Clock
+
+static led_clock_func led_clock = millis;
+
+// Use another clock for every animation, NULL goes back to `millis()`
+void set_led_clock(led_clock_func clock) {
+  led_clock = clock != NULL ? clock : millis;
+}
+
+unsigned long led_time() {
+  return led_clock();
+}
+
+static led_sleep_func led_sleep = NULL;
+
+void set_led_sleep(led_sleep_func func) {
+  led_sleep = func;
+}
 
 
 // Math Helpers
@@ -24,6 +76,57 @@ int triangle_wave(int amp, float freq, long time, int offset) {
 }
 
 
+// Random number streams
+
+/*
+Seed a stream, different stream ids give unrelated sequences for the same seed.
+
+The seed and stream are each scaled by their own odd constant before they are combined,
+adding them first gave seed 1 of stream 1 the same sequence as seed 2 of stream 0. The
+result is then mixed so nearby seeds don't produce nearby states, xorshift can never
+leave a zero state so that is avoided.
+*/
+void Rng::seed(uint32_t seed_value, uint8_t stream) {
+  state = (seed_value * 2654435761UL) ^ ((uint32_t)(stream + 1) * 0x85EBCA6BUL);
+  state ^= state >> 16;
+  state *= 0x7FEB352DUL;
+  state ^= state >> 15;
+  if (state == 0) {
+    state = 0x9E3779B9UL;
+  }
+}
+
+// xorshift32, period of 2^32 - 1
+uint32_t Rng::next() {
+  uint32_t x = state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  state = x;
+  return x;
+}
+
+// A fixed point fraction in [0, 1) as 0.16
+uint16_t Rng::frac16() {
+  return next() >> 16;
+}
+
+// Random value in [0, bound) without a division
+uint16_t Rng::below(uint16_t bound) {
+  return ((uint32_t)frac16() * bound) >> 16;
+}
+
+// Random value in [min, max), same range semantics as Arduino's `random(min, max)`
+int Rng::range(int min, int max) {
+  return min + below(max - min);
+}
+
+// Random value between min and max, scaled from a fixed point fraction
+float Rng::float_range(float min, float max) {
+  return min + (max - min) * (frac16() * (1.0 / 65536.0));
+}
+
+
 // Control Helpers
 
 /**
@@ -70,9 +173,40 @@ void dec_value(uint8_t* value, int min, int step = 1, bool clamp = false, int wr
   }
 }
 
+// Linear interpolation between two 8 bit values where an amount of 255 is almost all `to`
+uint8_t lerp8(uint8_t from, uint8_t to, uint8_t amount) {
+  // Unsigned on both sides, a signed product overflows the 16 bit int on AVR
+  if (to >= from) {
+    return from + (((uint16_t)(to - from) * amount) >> 8);
+  }
+  // Rounded down like a signed shift would
+  return from - (((uint16_t)(from - to) * amount + 255) >> 8);
+}
+
+/*
+Scale bytes by `amount / 256`, unrolled four at a time since this runs over the whole strip.
+
+@param bytes Start of the bytes to scale
+@param count Number of bytes
+@param amount Scale where 255 keeps almost everything and 0 clears
+*/
+void scale_bytes(uint8_t* bytes, uint16_t count, uint8_t amount) {
+  for (uint16_t blocks = count >> 2; blocks > 0; blocks--) {
+    bytes[0] = ((uint16_t)bytes[0] * amount) >> 8;
+    bytes[1] = ((uint16_t)bytes[1] * amount) >> 8;
+    bytes[2] = ((uint16_t)bytes[2] * amount) >> 8;
+    bytes[3] = ((uint16_t)bytes[3] * amount) >> 8;
+    bytes += 4;
+  }
+  for (count &= 3; count > 0; count--) {
+    *bytes = ((uint16_t)*bytes * amount) >> 8;
+    bytes++;
+  }
+}
+
 // Is a position already occupied in a particle array?
-bool is_in(int position, particle arr[]) {
-  for (int i = 0; i < 10; i++) {
+bool is_in(int position, particle arr[], int count) {
+  for (int i = 0; i < count; i++) {
     if (position == arr[i].position) {
       return true;
     }
@@ -80,11 +214,6 @@ bool is_in(int position, particle arr[]) {
   return false;
 }
 
-float float_rand( float min, float max) {
-  float scale = rand() / (float)RAND_MAX;
-  return min + scale * (max - min);
-}
-
 // LED_Bars control functions
 
 void LED_Bars::next_color() {
@@ -96,11 +225,15 @@ void LED_Bars::prev_color() {
 }
 
 void LED_Bars::next_pattern() {
+  uint8_t old_pattern = pattern_index;
   inc_value(&pattern_index, num_patterns - 1);
+  change_pattern(old_pattern, color_index);
 }
 
 void LED_Bars::prev_pattern() {
+  uint8_t old_pattern = pattern_index;
   dec_value(&pattern_index, 0, 1, false, num_patterns - 1);
+  change_pattern(old_pattern, color_index);
 }
 
 void LED_Bars::inc_color_hue() {
@@ -119,79 +252,883 @@ void LED_Bars::dec_brightness() {
   dec_value(&brightness, 0, 5, true);
 }
 
+// Select a pattern by its index, returns false if there is no such pattern
+bool LED_Bars::set_pattern_index(uint8_t index) {
+  if (index >= num_patterns) {
+    return false;
+  }
+  uint8_t old_pattern = pattern_index;
+  pattern_index = index;
+  change_pattern(old_pattern, color_index);
+  return true;
+}
+
+// Select a color by its index, returns false if there is no such color
+bool LED_Bars::set_color_index(uint8_t index) {
+  if (index >= num_colors) {
+    return false;
+  }
+  color_index = index;
+  return true;
+}
+
+void LED_Bars::set_color_hue(uint8_t hue) {
+  color_hue = hue;
+}
+
+void LED_Bars::set_brightness(uint8_t value) {
+  brightness = value;
+}
+
+uint8_t LED_Bars::get_pattern_index() {
+  return pattern_index;
+}
+
+uint8_t LED_Bars::get_color_index() {
+  return color_index;
+}
+
+uint8_t LED_Bars::get_color_hue() {
+  return color_hue;
+}
+
+uint8_t LED_Bars::get_brightness() {
+  return brightness;
+}
+
+uint8_t LED_Bars::get_num_patterns() {
+  return num_patterns;
+}
+
+uint8_t LED_Bars::get_num_colors() {
+  return num_colors;
+}
+
+unsigned long LED_Bars::get_frame_count() {
+  return frame_count;
+}
+
+// Restore the saved settings, anything missing, corrupt or out of range is left at its current value
 void LED_Bars::load_values() {
-  EEPROM.get(color_index_addr, color_index);
-  EEPROM.get(pattern_index_addr, pattern_index);
-  EEPROM.get(brightness_addr, brightness);
-  EEPROM.get(color_hue_addr, color_hue);
+  settings_record record;
+  if (settings.load(&record) == false) {
+    return;
+  }
+  if (record.color_index < num_colors) {
+    color_index = record.color_index;
+  }
+  brightness = record.brightness;
+  color_hue = record.color_hue;
+  if (record.pattern_index < num_patterns) {
+    set_pattern_index(record.pattern_index);
+  }
 }
 
+// Queue the current settings to be saved, the write happens over later frames
 void LED_Bars::save_values() {
-  EEPROM.put(color_index_addr, color_index);
-  EEPROM.put(pattern_index_addr, pattern_index);
-  EEPROM.put(brightness_addr, brightness);
-  EEPROM.put(color_hue_addr, color_hue);
+  settings_record record;
+  record.pattern_index = pattern_index;
+  record.color_index = color_index;
+  record.brightness = brightness;
+  record.color_hue = color_hue;
+  settings.save(record);
 }
 
 void LED_Bars::rand() {
-  pattern_index = random(0, num_patterns);
-  color_index = random(0, num_colors);
+  uint8_t old_pattern = pattern_index;
+  uint8_t old_color = color_index;
+  pattern_index = control_rng.below(num_patterns);
+  color_index = control_rng.below(num_colors);
+  change_pattern(old_pattern, old_color);
+}
+
+// Reseed every random stream so a run can be reproduced exactly
+void LED_Bars::seed(uint32_t value) {
+  control_rng.seed(value, RNG_CONTROL);
+  sparkle_rng.seed(value, RNG_SPARKLES);
+  particle_rng.seed(value, RNG_PARTICLES);
+  snakes.rng.seed(value, RNG_SNAKES);
+  game_of_life.rng.seed(value, RNG_LIFE);
+}
+
+/*
+Start the selected pattern over from a clean state, as if it had just been selected.
+
+Particles, timers and pattern state are released and set up again, and any crossfade, trail
+or dither carry is dropped. After `seed()` and with a clock set by `set_led_clock()` this
+renders the same frames every time. Zones keep running as they are.
+*/
+void LED_Bars::restart_pattern() {
+  if (n_zones > 0) {
+    return;
+  }
+  transitioning = false;
+  exit_pattern(pattern_index);
+  enter_pattern(pattern_index);
+
+  uint8_t kept_trail = trail;
+  trail = 0;
+  clear_frame();
+  trail = kept_trail;
+  if (dither_error != NULL) {
+    memset(dither_error, 0, strip.numPixels() * sizeof(uint16_t));
+  }
 }
 
-void LED_Bars::set_led_color(uint8_t x, uint8_t y, uint32_t color_value, uint8_t bright) {
+/*
+Reduce a channel scaled by brightness, out of 65535, to a step out of 255 with dithering.
+
+The top 4 bits below the step are added to the led's error for the channel, the nibble of
+`error` at `shift`. Once that carries past a whole step the channel shows one step brighter.
+*/
+static inline uint8_t dither_channel(uint16_t value, uint16_t* error, uint8_t shift) {
+  uint8_t sum = ((*error >> shift) & 0x0F) + ((value >> 4) & 0x0F);
+  *error = (*error & ~(0x0F << shift)) | ((uint16_t)(sum & 0x0F) << shift);
+  return (value >> 8) + (sum >> 4);
+}
+
+void LED_Bars::set_led_color(led_coord_t x, led_coord_t y, uint32_t color_value, uint8_t bright) {
+  PROFILE_SAMPLE(PROFILE_SET_LED);
+#ifndef LED_INDEXED
+  if (dither_error != NULL) {
+    uint16_t n = map_to_position(x, y);
+    uint8_t* pixel = strip.getPixels() + n * 3;
+    pixel[0] = dither_channel((uint16_t)(uint8_t)(color_value >> 8) * bright, dither_error + n, 0);
+    pixel[1] = dither_channel((uint16_t)(uint8_t)(color_value >> 16) * bright, dither_error + n, 4);
+    pixel[2] = dither_channel((uint16_t)(uint8_t)color_value * bright, dither_error + n, 8);
+    return;
+  }
+#endif
+#ifdef LED_INDEXED
+  cells[map_to_position(x, y)] = indexed_cell(palette_base + ((y * palette_step) >> 8), bright);
+#else
   strip.setPixelColor(map_to_position(x, y), color_value, bright);
+#endif
 }
 
-void LED_Bars::set_pattern(pattern_func func) {
-  unsigned int index = 0;
+// Color a led is currently showing, after brightness
+uint32_t LED_Bars::get_led_color(led_coord_t x, led_coord_t y) {
+#ifdef LED_INDEXED
+  uint8_t grb[3];
+  indexed_expand(cells[map_to_position(x, y)], palette, grb);
+  return ((uint32_t)grb[1] << 16) | ((uint32_t)grb[0] << 8) | grb[2];
+#else
+  return strip.getPixelColor(map_to_position(x, y));
+#endif
+}
+
+/*
+Add a color on top of whatever a led already shows, saturating each channel.
+
+Writes straight into the GRB strip buffer the same way `set_led_color()` scales by brightness.
+*/
+void LED_Bars::add_led_color(led_coord_t x, led_coord_t y, uint32_t color_value, uint8_t bright) {
+  PROFILE_SAMPLE(PROFILE_SET_LED);
+#ifdef LED_INDEXED
+  // The level adds up, the led takes the slot of whatever was drawn last
+  uint8_t* cell = cells + map_to_position(x, y);
+  uint8_t level = (*cell & 0x0F) + (bright >> 4);
+  *cell = indexed_cell(palette_base + ((y * palette_step) >> 8), min(level, 15) << 4);
+  return;
+#endif
+  uint16_t n = map_to_position(x, y);
+  uint8_t* pixel = strip.getPixels() + n * 3;
+  uint16_t g, r, b;
+  if (dither_error != NULL) {
+    g = pixel[0] + dither_channel((uint16_t)(uint8_t)(color_value >> 8) * bright, dither_error + n, 0);
+    r = pixel[1] + dither_channel((uint16_t)(uint8_t)(color_value >> 16) * bright, dither_error + n, 4);
+    b = pixel[2] + dither_channel((uint16_t)(uint8_t)color_value * bright, dither_error + n, 8);
+  } else {
+    g = pixel[0] + (((uint16_t)(uint8_t)(color_value >> 8) * bright) >> 8);
+    r = pixel[1] + (((uint16_t)(uint8_t)(color_value >> 16) * bright) >> 8);
+    b = pixel[2] + (((uint16_t)(uint8_t)color_value * bright) >> 8);
+  }
+  pixel[0] = g > 255 ? 255 : g;
+  pixel[1] = r > 255 ? 255 : r;
+  pixel[2] = b > 255 ? 255 : b;
+}
+
+/*
+Show a color at a position between two leds, splitting its brightness between them.
+
+Both leds are blended additively so lights passing each other or over a trail add up.
+
+@param x Segment of the led
+@param y Position along the segment in 1/256ths of a led
+@param color_value Packed color to show
+@param bright Brightness of the color if it sat exactly on one led
+*/
+void LED_Bars::set_led_color_subpixel(led_coord_t x, led_subpixel_t y, uint32_t color_value, uint8_t bright) {
+  led_coord_t led = y >> 8;
+  uint8_t fraction = y & 0xFF;
+  add_led_color(x, led, color_value, ((uint16_t)bright * (256 - fraction)) >> 8);
+  if (fraction > 0 && led + 1 < led_per_segment) {
+    add_led_color(x, led + 1, color_value, ((uint16_t)bright * fraction) >> 8);
+  }
+}
+
+// Find the index of a pattern function, unknown functions map to the first pattern
+uint8_t LED_Bars::pattern_lookup(pattern_func func) {
+  uint8_t index = 0;
   for (int i = 0; i < num_patterns; i++) {
     if (func == patterns[i]) {
       index = i;
       break;
     }
   }
-  pattern_index = index;
+  return index;
 }
 
-void LED_Bars::set_color(color_func func) {
-  unsigned int index = 0;
+// Find the index of a color function, unknown functions map to the first color
+uint8_t LED_Bars::color_lookup(color_func func) {
+  uint8_t index = 0;
   for (int i = 0; i < num_colors; i++) {
-    if (func == colors[i]) {
+    if (func == colors[i].func) {
       index = i;
       break;
     }
   }
-  color_index = index;
+  return index;
+}
+
+void LED_Bars::set_pattern(pattern_func func) {
+  uint8_t old_pattern = pattern_index;
+  add_pattern(func);
+  pattern_index = pattern_lookup(func);
+  change_pattern(old_pattern, color_index);
+}
+
+void LED_Bars::set_color(color_func func) {
+  add_color(func);
+  color_index = color_lookup(func);
+}
+
+/*
+Opt in to a pattern for a `-DLED_REGISTRY` build, appending it to the pattern table.
+
+Patterns are numbered in the order they are added, so add them before `begin()` loads the
+saved pattern and in the same order on every synced controller. `set_pattern()` and zones
+add their pattern themselves, but only without hooks, so `life`, `moving_snakes` and `fire`
+have to be added here first with theirs. In a normal build every pattern and hook is
+already there.
+
+@param enter Hook that sets up the pattern's state, `enter_life`, `enter_snakes` or `enter_fire`
+@param exit Hook that releases it, `exit_snakes` or NULL
+
+@return False if the table is full, or the pattern isn't built in without `LED_REGISTRY`
+*/
+bool LED_Bars::add_pattern(pattern_func func, pattern_func enter, pattern_func exit) {
+  bool found = false;
+  for (int i = 0; i < num_patterns; i++) {
+    if (patterns[i] == func) {
+      found = true;
+      break;
+    }
+  }
+#ifdef LED_REGISTRY
+  if (found == false) {
+    if (num_patterns >= LED_REGISTRY_PATTERNS) {
+      return false;
+    }
+    patterns[num_patterns++] = func;
+  }
+  // Hooks are only referenced from here, so they're linked with the pattern that uses them
+  if (enter != NULL && find_hooks(pattern_lookup(func)) == NULL
+      && num_stateful < sizeof(stateful_patterns) / sizeof(stateful_patterns[0])) {
+    stateful_patterns[num_stateful].func = func;
+    stateful_patterns[num_stateful].enter = enter;
+    stateful_patterns[num_stateful].exit = exit;
+    num_stateful++;
+  }
+  return true;
+#else
+  return found;
+#endif
+}
+
+/*
+Opt in to a color for a `-DLED_REGISTRY` build, see `add_pattern()`.
+
+@param kind What the color varies with, see `color_kind`. Position is always right, a
+frame or particle color that is marked as one is only worked out once a frame.
+*/
+bool LED_Bars::add_color(color_func func, uint8_t kind) {
+  for (int i = 0; i < num_colors; i++) {
+    if (colors[i].func == func) {
+      return true;
+    }
+  }
+#ifdef LED_REGISTRY
+  if (num_colors < LED_REGISTRY_COLORS) {
+    colors[num_colors].func = func;
+    colors[num_colors].kind = kind;
+    num_colors++;
+    return true;
+  }
+#endif
+  return false;
+}
+
+/*
+Split off a range of segments to run its own pattern and color.
+
+Once any zone exists only zones are rendered, segments outside every zone stay dark.
+The global pattern and color controls are left alone and take over again after `clear_zones()`.
+
+@param first_seg First segment of the zone
+@param n_segs Number of segments in the zone
+@param pattern_f Pattern to show in the zone
+@param color_f Color to show in the zone
+
+@return Index of the new zone or -1 if it doesn't fit or overlaps another zone
+*/
+int LED_Bars::add_zone(uint8_t first_seg, uint8_t n_segs, pattern_func pattern_f, color_func color_f) {
+  if (n_zones >= max_zones || n_segs == 0 || first_seg + n_segs > n_segments) {
+    return -1;
+  }
+  // Zones keep their particles and state in their segments' columns, they can't share any
+  for (uint8_t i = 0; i < n_zones; i++) {
+    if (first_seg < zones[i].first_segment + zones[i].n_segments
+        && zones[i].first_segment < first_seg + n_segs) {
+      return -1;
+    }
+  }
+  zone* zone_inst = &zones[n_zones];
+  *zone_inst = zone();
+  zone_inst->first_segment = first_seg;
+  zone_inst->n_segments = n_segs;
+  add_pattern(pattern_f);
+  add_color(color_f);
+  zone_inst->pattern_index = pattern_lookup(pattern_f);
+  zone_inst->color_index = color_lookup(color_f);
+  zone_inst->last_time = led_time();
+
+  // Zones take over from the global pattern
+  if (n_zones == 0) {
+    exit_pattern(pattern_index);
+  }
+  segment_offset = first_seg;
+  active_segments = n_segs;
+  active_zone = n_zones;
+  enter_pattern(zone_inst->pattern_index);
+  segment_offset = 0;
+  active_segments = n_segments;
+  active_zone = 0;
+  return n_zones++;
+}
+
+void LED_Bars::set_zone_pattern(uint8_t index, pattern_func func) {
+  if (index >= n_zones) {
+    return;
+  }
+  add_pattern(func);
+  segment_offset = zones[index].first_segment;
+  active_segments = zones[index].n_segments;
+  active_zone = index;
+  exit_pattern(zones[index].pattern_index);
+  zones[index].pattern_index = pattern_lookup(func);
+  zones[index].prev_seg = -1;
+  zones[index].last_time = led_time();
+  enter_pattern(zones[index].pattern_index);
+  segment_offset = 0;
+  active_segments = n_segments;
+  active_zone = 0;
+}
+
+void LED_Bars::set_zone_color(uint8_t index, color_func func) {
+  if (index >= n_zones) {
+    return;
+  }
+  add_color(func);
+  zones[index].color_index = color_lookup(func);
+}
+
+// Go back to rendering the global pattern on every segment
+void LED_Bars::clear_zones() {
+  if (n_zones == 0) {
+    return;
+  }
+  for (uint8_t i = 0; i < n_zones; i++) {
+    segment_offset = zones[i].first_segment;
+    active_segments = zones[i].n_segments;
+    active_zone = i;
+    exit_pattern(zones[i].pattern_index);
+  }
+  segment_offset = 0;
+  active_segments = n_segments;
+  active_zone = 0;
+  n_zones = 0;
+  enter_pattern(pattern_index);
+}
+
+/*
+Crossfade between patterns over `duration` ms when the pattern changes, 0 switches instantly.
+
+A crossfade needs a second frame, 3 bytes a led, and a copy of every segment's particles.
+Both are allocated here and kept until transitions are turned off, so pattern changes
+never touch the heap. For 4 segments of 60 leds that's 720 bytes of frame on top of the
+720 the strip already takes, most of what's left on a 2KB board, so check the result.
+
+@return False if there isn't enough memory, patterns keep switching instantly
+*/
+bool LED_Bars::set_transition(uint16_t duration) {
+  transitioning = false;
+#ifdef LED_INDEXED
+  // Blending two frames needs full color, indexed frames switch instantly
+  return duration == 0;
+#endif
+  if (duration > 0) {
+    if (transition_pixels == NULL) {
+      transition_pixels = (uint8_t*)malloc(strip.numPixels() * 3);
+    }
+    if (out_particles == NULL) {
+      out_particles = (particle (*)[LED_PARTICLES])malloc(n_segments * sizeof(particles[0]));
+    }
+    if (transition_pixels != NULL && out_particles != NULL) {
+      transition_duration = duration;
+      return true;
+    }
+  }
+  free(transition_pixels);
+  free(out_particles);
+  transition_pixels = NULL;
+  out_particles = NULL;
+  transition_duration = 0;
+  return duration == 0;
+}
+
+/*
+Leave a fading copy of the previous frame under each new one for trails behind moving lights.
+
+@param amount Share of the previous frame kept each frame out of 256, 0 clears every frame
+*/
+void LED_Bars::set_decay(uint8_t amount) {
+  trail = amount;
+}
+
+/*
+Carry the part of each led's color that falls between two steps over to later frames.
+
+At low brightness a gradient only has a handful of steps, dithering alternates leds between
+neighbouring steps so over a few frames they average out to the level in between. Costs
+2 bytes a led, allocated here, and works best at high frame rates where the alternation
+can't be seen.
+
+@return False if dithering couldn't be enabled for lack of memory
+*/
+bool LED_Bars::set_dither(bool enable) {
+#ifdef LED_INDEXED
+  // Indexed leds only have 16 levels, there's nothing finer to carry over
+  return false;
+#endif
+  if (enable == false) {
+    free(dither_error);
+    dither_error = NULL;
+    return true;
+  }
+  if (dither_error == NULL) {
+    dither_error = (uint16_t*)calloc(strip.numPixels(), sizeof(uint16_t));
+  }
+  return dither_error != NULL;
 }
 
-void LED_Bars::begin() {
+/*
+Correct each segment's colors as frames are sent, for strips that show colors differently.
+
+@param per_segment Curves for every segment in the order the segments were given, kept
+rather than copied. NULL sends frames as drawn.
+
+@return False if calibration isn't available, indexed frames have their own output and
+boards without the AVR output need memory for a copy of the frame
+*/
+bool LED_Bars::set_calibration(const led_calibration* per_segment) {
+#ifdef LED_INDEXED
+  return false;
+#endif
+#ifndef LED_SEND_AVR
+  if (per_segment == NULL) {
+    free(calibration_copy);
+    calibration_copy = NULL;
+  } else if (calibration_copy == NULL) {
+    calibration_copy = (uint8_t*)malloc(strip.numPixels() * 3);
+    if (calibration_copy == NULL) {
+      return false;
+    }
+  }
+#endif
+  segment_calibration = per_segment;
+  return true;
+}
+
+// Start a new frame by fading the last one, or clearing it without a trail
+void LED_Bars::clear_frame() {
+#ifdef LED_INDEXED
+  uint16_t count = n_segments * led_per_segment;
+  if (trail == 0) {
+    memset(cells, 0, count);
+  } else {
+    for (uint16_t i = 0; i < count; i++) {
+      cells[i] = indexed_cell(cells[i] >> 4, ((uint16_t)indexed_level(cells[i]) * trail) >> 8);
+    }
+  }
+  return;
+#endif
+  if (trail == 0) {
+    strip.clear();
+  } else {
+    scale_bytes(strip.getPixels(), strip.numPixels() * 3, trail);
+  }
+}
+
+void LED_Bars::set_audio(LED_Audio* source) {
+  audio = source;
+}
+
+void LED_Bars::set_program(LED_VM* program_vm) {
+  vm = program_vm;
+}
+
+void LED_Bars::set_frame_source(Stream* source) {
+  frame_source = source;
+  // Only sketches that stream refer to the pattern, others can leave it out
+  frames_pattern = &LED_Bars::external_frames;
+  ingest_state = INGEST_A;
+}
+
+/*
+Handle a change of the selected pattern.
+
+The old pattern exits and the new one enters on every segment and, if transitions are
+enabled, a crossfade starts from the old pattern and color. The old pattern's particles and
+timers are put aside for its remaining turns before the new one starts from a clean state.
+The frame currently on the strip is used as the outgoing frame until the outgoing pattern
+gets its first turn to render, or for the whole crossfade if the old pattern had state to
+release.
+
+@param old_pattern Index of the pattern being switched away from
+@param old_color Index of the color the old pattern was shown with
+*/
+void LED_Bars::change_pattern(uint8_t old_pattern, uint8_t old_color) {
+  // The global pattern isn't shown while zones are active
+  if (old_pattern == pattern_index || n_zones > 0) {
+    return;
+  }
+  // A pattern with state gives it up here, so its last frame is held
+  bool held = find_hooks(old_pattern) != NULL;
+  bool fade = transition_duration > 0 && is_off == false;
+  if (fade == true) {
+    memcpy(transition_pixels, strip.getPixels(), strip.numPixels() * 3);
+    memcpy(out_particles, particles, n_segments * sizeof(particles[0]));
+    out_prev_seg = prev_seg;
+    out_last_time = last_time;
+  }
+  exit_pattern(old_pattern);
+  enter_pattern(pattern_index);
+  if (fade == false) {
+    return;
+  }
+
+  out_pattern_index = old_pattern;
+  out_color_index = old_color;
+  render_outgoing = false;
+  outgoing_held = held;
+  transition_start = led_time();
+  transitioning = true;
+}
+
+// Release any particles and timers of the active segments so a new pattern starts from a clean state
+void LED_Bars::reset_state() {
+  for (int i = segment_offset; i < segment_offset + active_segments; i++) {
+    for (int j = 0; j < particle_count; j++) {
+      particles[i][j] = particle();
+    }
+  }
+  prev_seg = -1;
+  last_time = led_time();
+}
+
+/*
+Render a single frame of a crossfade.
+
+The outgoing and incoming patterns alternate frames, each running at half rate, so the
+frame time is one pattern plus a single blend pass. The freshly rendered frame is blended
+with the other pattern's last frame from `transition_pixels`, which is then swapped for
+the fresh raw frame in the same pass. Each pattern only renders every other frame, so
+frames are always cleared here and any trail picks up again once the transition ends.
+A held outgoing frame is never swapped out, the incoming pattern renders every frame
+and fades in over it.
+*/
+void LED_Bars::render_transition() {
+  unsigned long elapsed = led_time() - transition_start;
+  if (elapsed >= transition_duration) {
+    transitioning = false;
+    clear_frame();
+    prepare_color();
+    pattern();
+    return;
+  }
+
+  uint8_t in_pattern = pattern_index;
+  uint8_t in_color = color_index;
+  uint8_t amount = elapsed * 256 / transition_duration;
+  bool outgoing = render_outgoing == true && outgoing_held == false;
+  if (outgoing == true) {
+    pattern_index = out_pattern_index;
+    color_index = out_color_index;
+    amount = 255 - amount;
+    swap_outgoing_state();
+  }
+
+  strip.clear();
+  prepare_color();
+  pattern();
+  if (outgoing == true) {
+    swap_outgoing_state();
+  }
+  pattern_index = in_pattern;
+  color_index = in_color;
+  render_outgoing = !render_outgoing;
+
+  uint8_t* pixels = strip.getPixels();
+  uint16_t n_bytes = strip.numPixels() * 3;
+  uint8_t fresh;
+  for (uint16_t i = 0; i < n_bytes; i++) {
+    fresh = pixels[i];
+    pixels[i] = lerp8(transition_pixels[i], fresh, amount);
+    if (outgoing_held == false) {
+      transition_pixels[i] = fresh;
+    }
+  }
+}
+
+// Trade the particles and timers of the incoming pattern for those of the outgoing one
+void LED_Bars::swap_outgoing_state() {
+  particle (*incoming)[LED_PARTICLES] = particles;
+  particles = out_particles;
+  out_particles = incoming;
+
+  int seg = prev_seg;
+  prev_seg = out_prev_seg;
+  out_prev_seg = seg;
+
+  unsigned long time = last_time;
+  last_time = out_last_time;
+  out_last_time = time;
+}
+
+/*
+Restore the saved settings and start the strip.
+
+@return False if the geometry didn't fit the storage of a plain `LED_Bars` and only part of
+it is driven, build the library with a larger `LED_SEGMENTS` or `LED_PER_SEGMENT`
+*/
+bool LED_Bars::begin() {
+  load_values();
   strip.begin();
+#ifdef LED_INDEXED
+  cells = (uint8_t*)calloc(n_segments * led_per_segment, 1);
+#endif
   off();
+  return geometry_fits;
 }
 
 void LED_Bars::off() {
+  settings.update();
   if (is_off == false) {
+#ifdef LED_INDEXED
+    memset(cells, 0, n_segments * led_per_segment);
+#else
     strip.clear();
-    strip.show();
+#endif
+    show_frame();
     is_off = true;
   }
 }
 
+// Send the frame to the strip
+void LED_Bars::show_frame() {
+#if defined(LED_INDEXED) && defined(__AVR__)
+  indexed_show(strip.getPin(), cells, n_segments * led_per_segment, palette);
+#elif defined(LED_INDEXED)
+  uint8_t* pixels = strip.getPixels();
+  for (uint16_t i = 0; i < n_segments * led_per_segment; i++) {
+    indexed_expand(cells[i], palette, pixels + i * 3);
+  }
+  strip.show();
+#else
+  if (segment_calibration != NULL) {
+    show_calibrated();
+  } else {
+    strip.show();
+  }
+#endif
+}
+
+/*
+Send the frame through every segment's curves, leaving the strip buffer as it was drawn.
+
+The strip goes out as runs of `led_per_segment` leds, each run takes the curves of the
+segment wired there. Runs no segment starts on keep the first segment's curves.
+*/
+void LED_Bars::show_calibrated() {
+  const led_calibration* runs[n_segments];
+  for (uint8_t r = 0; r < n_segments; r++) {
+    runs[r] = segment_calibration;
+  }
+  for (uint8_t s = 0; s < n_segments; s++) {
+    unsigned int first = segments[s].first_position;
+    if (segments[s].reverse == true) {
+      first -= led_per_segment - 1;
+    }
+    uint8_t run = first / led_per_segment;
+    if (run < n_segments) {
+      runs[run] = &segment_calibration[s];
+    }
+  }
+
+#ifdef LED_SEND_AVR
+  calibrated_show(strip.getPin(), strip.getPixels(), led_per_segment, n_segments, runs);
+#else
+  uint8_t* pixels = strip.getPixels();
+  uint16_t run_bytes = led_per_segment * 3;
+  memcpy(calibration_copy, pixels, n_segments * run_bytes);
+  for (uint8_t r = 0; r < n_segments; r++) {
+    calibrate_pixels(pixels + r * run_bytes, led_per_segment, runs[r]);
+  }
+  strip.show();
+  memcpy(pixels, calibration_copy, n_segments * run_bytes);
+#endif
+}
+
+/*
+Blank the strip and sleep until an interrupt wakes the board, for use while off.
+
+Pending settings are written first since power down would stall them. Nothing else is
+reset, the next `render()` picks up with the same pattern and state. In power down `millis()`
+stops, so animations continue from where they were rather than jumping ahead.
+
+@param input Inputs that wake the board, sleep is skipped while it has queued events or
+the button is held so a press is never missed or cut short. NULL sleeps until any interrupt.
+*/
+void LED_Bars::sleep(LED_Input* input) {
+  settings.flush();
+  off();
+#ifdef __AVR__
+  // The ADC keeps drawing current while asleep, audio sampling carries on after waking
+  uint8_t adc = ADCSRA;
+  ADCSRA = adc & ~bit(ADEN);
+  set_sleep_mode(LED_SLEEP_MODE);
+  noInterrupts();
+  if (input == NULL || input->idle() == true) {
+    sleep_enable();
+#ifdef sleep_bod_disable
+    sleep_bod_disable();
+#endif
+    // The instruction after enabling interrupts always runs, a wake can't slip in before sleeping
+    interrupts();
+    sleep_cpu();
+    sleep_disable();
+  }
+  interrupts();
+  ADCSRA = adc;
+#else
+  if (led_sleep != NULL && (input == NULL || input->idle() == true)) {
+    led_sleep();
+  }
+#endif
+}
+
 void LED_Bars::render() {
+  bool show = true;
   is_off = false;
-  strip.clear();
-  pattern();
-  strip.show();
+#ifdef LED_PROFILE
+  profile.begin_frame();
+#endif
+  if (audio != NULL) {
+    audio->update();
+  }
+  if (n_zones > 0) {
+    clear_frame();
+    PROFILE_SCOPE(PROFILE_PATTERN);
+    render_zones();
+  } else if (transitioning == true) {
+    PROFILE_SCOPE(PROFILE_PATTERN);
+    render_transition();
+#ifndef LED_INDEXED
+  } else if (frame_source != NULL && patterns[pattern_index] == frames_pattern) {
+    // The strip still holds the last frame, only show once the next one is complete
+    PROFILE_SCOPE(PROFILE_PATTERN);
+    show = ingest_frames();
+#endif
+  } else {
+    clear_frame();
+    prepare_color();
+    PROFILE_SCOPE(PROFILE_PATTERN);
+    pattern();
+  }
+  if (show) {
+    {
+      PROFILE_SCOPE(PROFILE_SHOW);
+      show_frame();
+    }
+    frame_count++;
+#ifdef LED_PROFILE
+#ifdef __AVR__
+    profile.set_blocked(PROFILE_SHOW, (unsigned long)n_segments * led_per_segment * LED_PROFILE_SHOW_US);
+#endif
+    profile.end_frame(pattern_index);
+#endif
+  }
+  settings.update();
 }
 
-unsigned int LED_Bars::map_to_position(uint8_t x, uint8_t y) {
+/*
+Render every zone's pattern into its own segments.
+
+The zone's pattern, color and timing state are swapped in around the pattern call
+so patterns only ever see the segments of the zone they are drawing.
+*/
+void LED_Bars::render_zones() {
+  uint8_t main_pattern = pattern_index;
+  uint8_t main_color = color_index;
+  int main_prev_seg = prev_seg;
+  unsigned long main_last_time = last_time;
+
+  for (uint8_t i = 0; i < n_zones; i++) {
+    zone* zone_inst = &zones[i];
+    active_zone = i;
+    segment_offset = zone_inst->first_segment;
+    active_segments = zone_inst->n_segments;
+    pattern_index = zone_inst->pattern_index;
+    color_index = zone_inst->color_index;
+    prev_seg = zone_inst->prev_seg;
+    last_time = zone_inst->last_time;
+
+    prepare_color();
+    pattern();
+
+    zone_inst->prev_seg = prev_seg;
+    zone_inst->last_time = last_time;
+  }
+
+  active_zone = 0;
+  segment_offset = 0;
+  active_segments = n_segments;
+  pattern_index = main_pattern;
+  color_index = main_color;
+  prev_seg = main_prev_seg;
+  last_time = main_last_time;
+}
+
+// Map a coordinate in the active segments to its led index on the strip
+unsigned int LED_Bars::map_to_position(led_coord_t x, led_coord_t y) {
   segment seg;
   unsigned int pos;
   if (vertical == true) {
-    seg = segments[x];
+    seg = segments[x + segment_offset];
     pos = y;
   } else {
-    seg = segments[y];
+    seg = segments[y + segment_offset];
     pos = x;
   }
     
@@ -211,19 +1148,70 @@ void LED_Bars::pattern() {
   return (this->*pattern_f)();
 }
 
+// Hooks of a pattern, NULL for patterns without state of their own
+const LED_Bars::pattern_hooks* LED_Bars::find_hooks(uint8_t index) {
+  for (uint8_t i = 0; i < num_stateful; i++) {
+    if (stateful_patterns[i].func == patterns[index]) {
+      return &stateful_patterns[i];
+    }
+  }
+  return NULL;
+}
+
+// Start a pattern on the active segments from a clean state
+void LED_Bars::enter_pattern(uint8_t index) {
+  reset_state();
+  const pattern_hooks* hooks = find_hooks(index);
+  if (hooks != NULL && alloc_pattern_state() == true) {
+    (this->*hooks->enter)();
+  }
+}
+
+// Let a pattern release whatever it keeps for the active segments
+void LED_Bars::exit_pattern(uint8_t index) {
+  const pattern_hooks* hooks = find_hooks(index);
+  if (hooks != NULL && hooks->exit != NULL) {
+    (this->*hooks->exit)();
+  }
+}
+
+/*
+Allocate the state shared by stateful patterns, returns false if there isn't enough memory.
+
+Patterns check for it themselves and fall back to `fill` without it.
+*/
+bool LED_Bars::alloc_pattern_state() {
+  if (pattern_state != NULL) {
+    return true;
+  }
+  uint16_t board_words = 2 * LIFE_WORDS(led_per_segment);
+  uint16_t heat_words = (led_per_segment + 3) / 4;
+  state_stride = max(board_words, heat_words);
+  pattern_state = (uint32_t*)malloc(n_segments * state_stride * sizeof(uint32_t));
+  if (pattern_state == NULL) {
+    return false;
+  }
+  game_of_life.attach(pattern_state, state_stride);
+  snakes.attach(pattern_state, state_stride);
+  return true;
+}
+
 // Fill all the leds
 void LED_Bars::fill() {
-  for (int i = 0; i < n_segments; i++) {
+  for (int i = 0; i < active_segments; i++) {
     for (int j = 0; j < led_per_segment; j++) {
       set_led_color(i, j, color(j, i, 0.0), 125);
     }
   }
 }
 
-// Fill all leds but glow between off and on every 5 seconds
+// Fill all leds but glow between off and on every 5 seconds, or with the bass when there's audio
 void LED_Bars::glow() {
-  int bright = sine_wave(125, 0.0002, millis(), 125);
-  for (int i = 0; i < n_segments; i++) {
+  int bright = sine_wave(125, 0.0002, led_time(), 125);
+  if (audio != NULL) {
+    bright = ((uint16_t)audio->bass() * 250) >> 8;
+  }
+  for (int i = 0; i < active_segments; i++) {
     for (int j = 0; j < led_per_segment; j++) {
       set_led_color(i, j, color(j, i, 0.0), bright);
     }
@@ -246,14 +1234,25 @@ void LED_Bars::calc_bounce(
   int (*pos_func)(int amp, float freq, long time, int offset)
   ) {
   int amplitude = led_per_segment / 2;
+  // Louder sound swings further from the middle, out of 256
+  int swing = audio != NULL ? max(audio->level, (uint8_t)32) : 256;
   int line_offset = ( 1 / freq ) / n_lines;
   int pos_offset = drift == true ? 10 : 0;
 
+  /*
+  Waves are evaluated with the amplitude in 1/128ths of a led, which still fits an `int`
+  for segments up to 255 leds. Longer segments move a whole led at a time.
+  */
+  uint8_t fraction_bits = led_per_segment < 256 ? 7 : 0;
+  long sub_amplitude = (long)amplitude << fraction_bits;
+
   for (int i = 0; i < n_lines; i++) {
-    for (int j = 0; j < n_segments; j++) {
+    for (int j = 0; j < active_segments; j++) {
       int time_offset = (j * pos_offset) + (i * line_offset);
-      int pos = pos_func(amplitude, freq, millis() + time_offset, amplitude);
-      set_led_color(j, pos, color(pos, j, 0.0), 125);
+      long pos = pos_func(sub_amplitude, freq, led_time() + time_offset, sub_amplitude);
+      pos = sub_amplitude + (((pos - sub_amplitude) * swing) >> 8);
+      pos = constrain(pos << (8 - fraction_bits), 0, ((long)led_per_segment - 1) << 8);
+      set_led_color_subpixel(j, pos, color(pos >> 8, j, 0.0), 125);
     }
   }
 }
@@ -305,36 +1304,37 @@ void LED_Bars::cycle_sparkles(bool drift) {
   float freq;
   int hue_drift_value;
 
-  for (int i = 0; i < n_segments; i++) {
+  for (int i = 0; i < active_segments; i++) {
+    particle* seg_particles = particles[segment_offset + i];
     for (int j = 0; j < particle_count; j++) {
       // Create a new sparkle instance with a unique position
       // and frequency, a zero freq indicates this sparkle has
       // finished it's animation cycle and can be replaced
-      if (particles[i][j].freq == 0.0) {
+      if (seg_particles[j].freq == 0.0) {
         do {
-          pos = random(0, led_per_segment);
-        } while (is_in(pos, particles[i]));
+          pos = sparkle_rng.below(led_per_segment);
+        } while (is_in(pos, seg_particles, particle_count));
         // To get the desired "glow" effect a frequency must be chosen
         // that is currently at a minimum in its sinusoid cycle
         // This causes the particle to go from 0->255->0 in brightness smoothly
         do {
-          freq = float_rand(0.001, 0.0001);
-          bright = sine_wave(125, freq, millis(), 125);
+          freq = sparkle_rng.float_range(0.001, 0.0001);
+          bright = sine_wave(125, freq, led_time(), 125);
         } while (bright != 0);
 
-        particles[i][j].position = pos;
-        particles[i][j].freq = freq;
-        particles[i][j].hue_drift = random(-1500, 1501);
-        particles[i][j].start_time = millis();
+        seg_particles[j].position = pos;
+        seg_particles[j].freq = freq;
+        seg_particles[j].hue_drift = sparkle_rng.range(-1500, 1501);
+        seg_particles[j].start_time = led_time();
       } else {
         // If the sparkle has already ran for a cycle then it is removed
-        bright = sine_wave(125, particles[i][j].freq, millis(), 125);
-        if (bright == 0 && (millis() - particles[i][j].start_time) > 100) {
-          particles[i][j].freq = 0.0;
+        bright = sine_wave(125, seg_particles[j].freq, led_time(), 125);
+        if (bright == 0 && (led_time() - seg_particles[j].start_time) > 100) {
+          seg_particles[j].freq = 0.0;
         } else {
           // Render valid sparkle particles
-          hue_drift_value = drift == true ? particles[i][j].hue_drift : 0;
-          pos = particles[i][j].position;
+          hue_drift_value = drift == true ? seg_particles[j].hue_drift : 0;
+          pos = seg_particles[j].position;
           set_led_color(i, pos, color(pos, i, hue_drift_value), bright);
         }
       }
@@ -356,16 +1356,16 @@ void LED_Bars::sparkles_drift() {
 // Motion based patterns
 
 // Simple linear displacement calculation from top to bottom
-int moving_calc(unsigned long time, int count, float vel) {
+long moving_calc(unsigned long time, int count, float vel) {
   uint32_t anim_speed = 500;
   float init_v = count / anim_speed;
-  return (init_v * time);
+  return (init_v * time) * 256;
 }
 
 // Simple linear displacement calculation from bottom to top
-int upward_calc(unsigned long time, int count, float vel) {
-  int value = moving_calc(time, count, vel);
-  return (count - 1) - value;
+long upward_calc(unsigned long time, int count, float vel) {
+  long value = moving_calc(time, count, vel);
+  return ((long)(count - 1) << 8) - value;
 }
 
 /*
@@ -374,17 +1374,17 @@ To create a falling effect the light positions are calculated by a simple kinema
 The values below work as configurations for this. By default the positions move with velocity and acceleration
 at a rate that they will reach full velocity (led_per_segment/anim_speed) by the bottom. Units in led/ms.
 */
-int falling_calc(unsigned long time, int count, float vel) {
+long falling_calc(unsigned long time, int count, float vel) {
   uint32_t anim_speed = 1000;
   float init_v = 0.01 * (count / anim_speed);
   float acc = (2 * (count - (init_v * anim_speed))) / pow(anim_speed, 2);
-  return (init_v * time) + (0.5 * acc * pow(time, 2));
+  return ((init_v * time) + (0.5 * acc * pow(time, 2))) * 256;
 }
 
 // Same as above but moves from bottom to top
-int rising_calc(unsigned long time, int count, float vel) {
-  int value = falling_calc(time, count, vel);
-  return (count - 1) - value;
+long rising_calc(unsigned long time, int count, float vel) {
+  long value = falling_calc(time, count, vel);
+  return ((long)(count - 1) << 8) - value;
 }
 
 /*
@@ -392,17 +1392,17 @@ Creates a falling effect with variable speeds using the same equations above.
 This however expects a velocity to be provided and is intended for use with
 the `particle` struct.
 */
-int falling_calc_rand(unsigned long time, int count, float vel) {
+long falling_calc_rand(unsigned long time, int count, float vel) {
   uint32_t anim_speed = 1000;
   float init_v = 0.01 * (count / anim_speed);
   float acc = (2 * (count - (init_v * anim_speed))) / pow(anim_speed, 2);
-  return (vel * time) + (0.5 * acc * pow(time, 2));
+  return ((vel * time) + (0.5 * acc * pow(time, 2))) * 256;
 }
 
 // Same as above but moves from bottom to top
-int rising_calc_rand(unsigned long time, int count, float vel) {
-  int value = falling_calc_rand(time, count, vel);
-  return (count - 1) - value;
+long rising_calc_rand(unsigned long time, int count, float vel) {
+  long value = falling_calc_rand(time, count, vel);
+  return ((long)(count - 1) << 8) - value;
 }
 
 /*
@@ -421,47 +1421,51 @@ effects.
 */
 void LED_Bars::cycle_particles(
   unsigned int active_seg, bool no_gen, bool glow, bool hue_drift,
-  int (*pos_func)(unsigned long time, int count, float vel)
+  long (*pos_func)(unsigned long time, int count, float vel)
   ) {
   unsigned long time;
   unsigned long particle_time;
-  int position;
+  long position;
   int bright;
   float vel;
   float freq;
   int hue_drift_value;
 
-  for (int i = 0; i < n_segments; i++) {
+  for (int i = 0; i < active_segments; i++) {
+    particle* seg_particles = particles[segment_offset + i];
     for (int j = 0; j < particle_count; j++) {
-      particle_time = particles[i][j].start_time;
+      particle_time = seg_particles[j].start_time;
 
       // Generate a single new position once per segment
       if (active_seg == i && particle_time == 0 && no_gen == false) {
-        particles[i][j].start_time = millis();
-        particles[i][j].vel = float_rand(0.0001, 0.01);
-        particles[i][j].freq = float_rand(0.0001, 0.001);
-        particles[i][j].hue_drift = random(-1500, 1501);
-        particle_time = particles[i][j].start_time;
+        seg_particles[j].start_time = led_time();
+        seg_particles[j].vel = particle_rng.float_range(0.0001, 0.01);
+        seg_particles[j].freq = particle_rng.float_range(0.0001, 0.001);
+        seg_particles[j].hue_drift = particle_rng.range(-1500, 1501);
+        particle_time = seg_particles[j].start_time;
         no_gen = true;
       }
+      if (particle_time == 0) {
+        continue;
+      }
 
       // Calculate position offset from the top
-      time = millis() - particle_time;
-      vel = particles[i][j].vel;
-      freq = particles[i][j].freq;
+      time = led_time() - particle_time;
+      vel = seg_particles[j].vel;
+      freq = seg_particles[j].freq;
       position = pos_func(time, led_per_segment, vel);
 
       // Show any active position within the led boundary and
       // release positions that fall out of bounds
-      if (position >= led_per_segment || position < 0) {
-        particles[i][j].start_time = 0;
+      if (position >= ((long)led_per_segment << 8) || position < 0) {
+        seg_particles[j].start_time = 0;
       } else {
         // Only render a zero position if it is being generated in this cycle,
         // without this the other zero position are always shwon at the top
-        if (!(position == 0 && i != active_seg)) {
-          bright = glow == true ? sine_wave(125, freq, millis(), 125) : 125;
-          hue_drift_value = hue_drift == true ? particles[i][j].hue_drift : 0;
-          set_led_color(i, position, color(position, i, hue_drift_value), bright);
+        if (!((position >> 8) == 0 && i != active_seg)) {
+          bright = glow == true ? sine_wave(125, freq, led_time(), 125) : 125;
+          hue_drift_value = hue_drift == true ? seg_particles[j].hue_drift : 0;
+          set_led_color_subpixel(i, position, color(position >> 8, i, hue_drift_value), bright);
         }
       }
     }
@@ -482,12 +1486,12 @@ the triangle wave looks the best as it is completley linear between its amplitud
 int gen_seg(int n_segments) {
   int amplitude = n_segments / 2;
   float frequency = 0.004;
-  return triangle_wave(amplitude, frequency, millis(), amplitude);
+  return triangle_wave(amplitude, frequency, led_time(), amplitude);
 }
 
 // Show a constantly moving waveform
 void LED_Bars::waves() {
-  int active_seg = gen_seg(n_segments);
+  int active_seg = gen_seg(active_segments);
 
   bool no_gen = true;
   if (prev_seg != active_seg) {
@@ -500,7 +1504,7 @@ void LED_Bars::waves() {
 
 // Shows a vertical wave like pattern that falls faster as it moves
 void LED_Bars::falling_waves() {
-  int active_seg = gen_seg(n_segments);
+  int active_seg = gen_seg(active_segments);
 
   bool no_gen = true;
   if (prev_seg != active_seg) {
@@ -511,13 +1515,17 @@ void LED_Bars::falling_waves() {
   cycle_particles(active_seg, no_gen, false, false, falling_calc);
 }
 
-// Show random falling lights of varying speeds
+// Show random falling lights of varying speeds, faster and on every beat with audio
 void LED_Bars::falling_rain() {
-  int gen_seg = random(0, n_segments);
+  int gen_seg = particle_rng.below(active_segments);
 
   bool no_gen = true;
-  if ((millis() - last_time) > random(50, 150)) {
-    last_time = millis();
+  unsigned long spawn_time = particle_rng.range(50, 150);
+  if (audio != NULL) {
+    spawn_time = (spawn_time * (256 - (audio->level * 3 >> 2))) >> 8;
+  }
+  if ((led_time() - last_time) > spawn_time || (audio != NULL && audio->beat)) {
+    last_time = led_time();
     no_gen = false;
   }
 
@@ -526,11 +1534,11 @@ void LED_Bars::falling_rain() {
 
 // Show random falling lights of varying speeds that slowly blink
 void LED_Bars::falling_sparkles() {
-  int gen_seg = random(0, n_segments);
+  int gen_seg = particle_rng.below(active_segments);
   
   bool no_gen = true;
-  if ((millis() - last_time) > random(50, 150)) {
-    last_time = millis();
+  if ((led_time() - last_time) > particle_rng.range(50, 150)) {
+    last_time = led_time();
     no_gen = false;
   }
 
@@ -540,11 +1548,11 @@ void LED_Bars::falling_sparkles() {
 // Show random falling lights of varying speeds that slowly blink
 // and apply a color variation for a sort of shimmer
 void LED_Bars::falling_drift_sparkles() {
-  int gen_seg = random(0, n_segments);
+  int gen_seg = particle_rng.below(active_segments);
 
   bool no_gen = true;
-  if ((millis() - last_time) > random(50, 150)) {
-    last_time = millis();
+  if ((led_time() - last_time) > particle_rng.range(50, 150)) {
+    last_time = led_time();
     no_gen = false;
   }
 
@@ -554,7 +1562,7 @@ void LED_Bars::falling_drift_sparkles() {
 // Shows a vertical wave like pattern that falls faster as it moves
 // with lights that slowly blink and apply a color variation for a sort of shimmer
 void LED_Bars::falling_drift_sparkle_waves() {
-  int active_seg = gen_seg(n_segments);
+  int active_seg = gen_seg(active_segments);
 
   bool no_gen = true;
   if (prev_seg != active_seg) {
@@ -567,7 +1575,7 @@ void LED_Bars::falling_drift_sparkle_waves() {
 
 // The same pattern as above but this on goes from bottom to top
 void LED_Bars::rising_drift_sparkle_waves() {
-  int active_seg = gen_seg(n_segments);
+  int active_seg = gen_seg(active_segments);
 
   bool no_gen = true;
   if (prev_seg != active_seg) {
@@ -604,10 +1612,10 @@ bool point_in_arr(point pnt, point arr[], unsigned int arr_size) {
 }
 
 // Shuffle an array
-void shuffle(int *array, size_t n) {
+void shuffle(int *array, size_t n, Rng &rng) {
   size_t i;
   for (i = 0; i < n - 1; i++) {
-    size_t j = i + rand() / (RAND_MAX / (n - i) + 1);
+    size_t j = i + rng.below(n - i);
     int t = array[j];
     array[j] = array[i];
     array[i] = t;
@@ -644,7 +1652,7 @@ affinity for the directionality of the snakes' movements
 */
 point* Snakes::adjacent_points(point pnt) {
   int disp[4] = { 0, 1, 2, 3 };
-  shuffle(disp, 4);
+  shuffle(disp, 4, rng);
   static point next_points[4];
   for (int i = 0; i < 4; i++) {
     next_points[i] = random_adjacent(pnt, disp[i]);
@@ -655,6 +1663,9 @@ point* Snakes::adjacent_points(point pnt) {
 // Does a given point intersect with any other points
 bool Snakes::point_collision(point pnt) {
   for (int i = 0; i < snake_count; i++) {
+    if (snake_insts[i] == NULL) {
+      continue;
+    }
     if (point_in_arr(pnt, snake_insts[i]->points, snake_insts[i]->length) == true) {
       return true;
     }
@@ -664,10 +1675,10 @@ bool Snakes::point_collision(point pnt) {
 
 // Is a given point within the led space and not occupied
 bool Snakes::valid_point(point pnt) {
-  uint8_t x = pnt.x;
-  uint8_t y = pnt.y;
+  led_coord_t x = pnt.x;
+  led_coord_t y = pnt.y;
 
-  if (x >= width) {
+  if (x < first_column || x >= end_column) {
     return false;
   } else if (y >= height) {
     return false;
@@ -679,103 +1690,264 @@ bool Snakes::valid_point(point pnt) {
 }
 
 snake* Snakes::create_snake() {
-  uint8_t length = random(5, 10);
+  uint8_t length = rng.range(5, 10);
   point pnt;
-  snake *snake_inst = malloc(sizeof(snake) + length * sizeof(point *));
+  snake *snake_inst = (snake*)malloc(sizeof(snake) + length * sizeof(point));
+  if (snake_inst == NULL) {
+    return NULL;
+  }
 
   do {
-    pnt = { .x = random(0, width), .y = random(0, height) };
+    pnt = { .x = first_column + rng.below(end_column - first_column), .y = rng.below(height) };
   } while (!(valid_point(pnt) == true));
   for (int i = 0; i < length; i++) {
     snake_inst->points[i] = pnt;  
   }
   snake_inst->length = length;
-  snake_inst->hue_drift = random(-3000, 3001);
-  snake_inst->start_time = millis();
-  snake_inst->delay = random(250, 750);
+  snake_inst->hue_drift = rng.range(-3000, 3001);
+  snake_inst->start_time = led_time();
+  snake_inst->delay = rng.range(250, 750);
   return snake_inst;
 }
 
 void Snakes::remove_snake(uint8_t index) {
   free(snake_insts[index]);
+  snake_insts[index] = NULL;
 }
 
-void Snakes::move_snake(uint8_t index) {
-  point pnt;
-  pnt = snake_insts[index]->points[0];
+void Snakes::attach(uint32_t* boards, uint16_t column_words) {
+  stride = column_words;
+  free_cells = boards;
+  reached = boards + words;
+}
+
+// Limit new snakes and moves to a range of columns
+void Snakes::set_bounds(uint8_t first, uint8_t count) {
+  first_column = first;
+  end_column = first + count;
+}
+
+// Set the bits of every cell in the current columns that no snake is on
+void Snakes::mark_free_cells() {
+  uint8_t tail = height % 32;
+  for (uint8_t x = first_column; x < end_column; x++) {
+    uint32_t* column = free_cells + x * stride;
+    for (uint8_t w = 0; w < words; w++) {
+      column[w] = tail != 0 && w == words - 1 ? (1UL << tail) - 1 : 0xFFFFFFFF;
+    }
+  }
+  for (uint8_t i = 0; i < snake_count; i++) {
+    if (snake_insts[i] == NULL) {
+      continue;
+    }
+    for (uint8_t j = 0; j < snake_insts[i]->length; j++) {
+      point pnt = snake_insts[i]->points[j];
+      if (pnt.x >= first_column && pnt.x < end_column && pnt.y < height) {
+        free_cells[pnt.x * stride + pnt.y / 32] &= ~(1UL << (pnt.y % 32));
+      }
+    }
+  }
+}
+
+/*
+Count the free cells a snake at `start` could get to in `LED_SNAKE_LOOKAHEAD` moves.
+
+Every pass grows the reached cells by one step in all four directions at once, a whole
+column word at a time, and keeps only free cells. Updating in place lets a pass spread
+further than one step, which only makes the estimate a little more generous. Stops early
+once nothing grows or `enough` cells are reached.
+*/
+uint16_t Snakes::reachable_area(point start, uint16_t enough) {
+  for (uint8_t x = first_column; x < end_column; x++) {
+    for (uint8_t w = 0; w < words; w++) {
+      reached[x * stride + w] = 0;
+    }
+  }
+  reached[start.x * stride + start.y / 32] = 1UL << (start.y % 32);
+
+  uint16_t area = 1;
+  for (uint8_t step = 0; step < LED_SNAKE_LOOKAHEAD && area < enough; step++) {
+    uint16_t grown_area = 0;
+    for (uint8_t x = first_column; x < end_column; x++) {
+      uint32_t* column = reached + x * stride;
+      for (uint8_t w = 0; w < words; w++) {
+        uint32_t cells = column[w];
+        uint32_t grown = cells | (cells << 1) | (cells >> 1);
+        if (w > 0) {
+          grown |= column[w - 1] >> 31;
+        }
+        if (w + 1 < words) {
+          grown |= column[w + 1] << 31;
+        }
+        if (x > first_column) {
+          grown |= column[w - stride];
+        }
+        if (x + 1 < end_column) {
+          grown |= column[w + stride];
+        }
+        grown &= free_cells[x * stride + w] | cells;
+        column[w] = grown;
+        for (; grown != 0; grown &= grown - 1) {
+          grown_area++;
+        }
+      }
+    }
+    if (grown_area == area) {
+      break;
+    }
+    area = grown_area;
+  }
+  return area;
+}
 
-  point* next_pnts = adjacent_points(pnt);
-  int k = 0;
-  for (k = 0; k < 4; k++) {
-    if (valid_point(*(next_pnts + k)) == true) {
-      arr_push(*(next_pnts + k), snake_insts[index]->points, snake_insts[index]->length);
+/*
+Move a snake's head to one of its free neighbours.
+
+Neighbours are tried in a random order and the first with room for twice the snake's length
+within the lookahead is taken, so snakes in open space still wander at random. When none
+has that much room the one with the most is taken, steering away from dead ends.
+*/
+void Snakes::move_snake(uint8_t index) {
+  snake* snake_inst = snake_insts[index];
+  if (snake_inst == NULL) {
+    return;
+  }
+  point* next_pnts = adjacent_points(snake_inst->points[0]);
+  uint16_t enough = snake_inst->length * 2;
+  uint16_t best_area = 0;
+  int8_t best = -1;
+  bool marked = false;
+
+  for (uint8_t k = 0; k < 4; k++) {
+    if (valid_point(next_pnts[k]) == false) {
+      continue;
+    }
+    if (marked == false) {
+      mark_free_cells();
+      marked = true;
+    }
+    uint16_t area = reachable_area(next_pnts[k], enough);
+    if (area > best_area) {
+      best_area = area;
+      best = k;
+    }
+    if (area >= enough) {
       break;
     }
   }
-  if (k >= 4) {
+  if (best >= 0) {
+    arr_push(next_pnts[best], snake_inst->points, snake_inst->length);
+  } else {
     // Snake failed to find a valid spot and may be stuck
+    respawns++;
     remove_snake(index);
     snake_insts[index] = create_snake();
   }
 }
 
+// Every zone gets its own snake, kept inside the zone's segments
+void LED_Bars::enter_snakes() {
+  snakes.set_bounds(segment_offset, active_segments);
+  snakes.remove_snake(active_zone);
+  snakes.snake_insts[active_zone] = snakes.create_snake();
+}
+
+void LED_Bars::exit_snakes() {
+  snakes.remove_snake(active_zone);
+}
+
 // Show a series of moving segments similar to the classic snake game
 void LED_Bars::moving_snakes() {
   point pnt;
-  point pnt1;
-  bool done = false;
   unsigned int bright = 125;
-  snake* snake_inst;
-
-  for (int i = 0; i < snakes.snake_count; i++) {
-    snake_inst = snakes.snake_insts[i];
-    for (int j = 0; j < snake_inst->length; j++) {
-      pnt = snake_inst->points[j];
-      if (j == 0) {
-        bright = (millis() - snake_inst->start_time) * 125 / snake_inst->delay;
-      } else if (j == snake_inst->length - 1 && !point_eq(pnt, snake_inst->points[j - 1])) {
-        bright = (millis() - snake_inst->start_time) * 125 / snake_inst->delay;
-        bright = 130 - bright;
-      } else {
-        bright = 125;
-      }
-      set_led_color(pnt.x, pnt.y, color(pnt.y, pnt.x, snake_inst->hue_drift), bright);
+  if (pattern_state == NULL) {
+    fill();
+    return;
+  }
+
+  uint8_t index = active_zone;
+  snakes.set_bounds(segment_offset, active_segments);
+  snake* snake_inst = snakes.snake_insts[index];
+  if (snake_inst == NULL || snake_inst->points[0].x < segment_offset
+      || snake_inst->points[0].x >= segment_offset + active_segments) {
+    if (snake_inst != NULL) {
+      snakes.remove_snake(index);
+    }
+    snakes.snake_insts[index] = snakes.create_snake();
+    snake_inst = snakes.snake_insts[index];
+    if (snake_inst == NULL) {
+      fill();
+      return;
     }
+  }
 
-    if (millis() - snake_inst->start_time > snake_inst->delay) {
-      snake_inst->start_time = millis();
-      snakes.move_snake(i);
+  for (int j = 0; j < snake_inst->length; j++) {
+    pnt = snake_inst->points[j];
+    if (j == 0) {
+      bright = (led_time() - snake_inst->start_time) * 125 / snake_inst->delay;
+    } else if (j == snake_inst->length - 1 && !point_eq(pnt, snake_inst->points[j - 1])) {
+      bright = (led_time() - snake_inst->start_time) * 125 / snake_inst->delay;
+      bright = 130 - bright;
+    } else {
+      bright = 125;
     }
+    led_coord_t x = pnt.x - segment_offset;
+    set_led_color(x, pnt.y, color(pnt.y, x, snake_inst->hue_drift), bright);
+  }
+
+  if (led_time() - snake_inst->start_time > snake_inst->delay) {
+    snake_inst->start_time = led_time();
+    snakes.move_snake(index);
   }
 }
 
+void GameOfLife::attach(uint32_t* board, uint16_t column_words) {
+  area = board;
+  stride = column_words;
+}
+
 void GameOfLife::random_board() {
-  for (int x = 0; x < width; x++) {
-    for (int y = 0; y < height; y++) {
-      area[x][y] = (bool)random(0, 2);
+  random_board(0, width);
+}
+
+// Fill a range of columns a whole word at a time, masking off any bits past the last row
+void GameOfLife::random_board(uint8_t first, uint8_t count) {
+  uint8_t tail = height % 32;
+  for (int x = first; x < first + count; x++) {
+    uint32_t* column = area + x * stride;
+    for (int w = 0; w < words; w++) {
+      if (tail != 0 && w == words - 1) {
+        column[w] = rng.next() & ((1UL << tail) - 1);
+      } else {
+        column[w] = rng.next();
+      }
     }
   }
 }
 
-bool GameOfLife::out_of_bounds(uint8_t x, uint8_t y) {
-  return x >= width || x < 0 || y >= height || y < 0;
+bool GameOfLife::cell(led_coord_t x, led_coord_t y) {
+  return (area[x * stride + y / 32] >> (y % 32)) & 1;
 }
 
+bool GameOfLife::out_of_bounds(led_coord_t x, led_coord_t y) {
+  return x >= end_column || x < first_column || y >= height;
+}
+
+// Make the next board of each updated column the current one
 void GameOfLife::copy_area() {
-  for (int x = 0; x < width; x++) {
-    for (int y = 0; y < height; y++) {
-      area[x][y] = area_n[x][y];
-    }
+  for (int x = first_column; x < end_column; x++) {
+    uint32_t* column = area + x * stride;
+    memcpy(column, column + words, words * sizeof(uint32_t));
   }
 }
 
-uint8_t GameOfLife::live_neighbors(uint8_t x, uint8_t y) {
+uint8_t GameOfLife::live_neighbors(led_coord_t x, led_coord_t y) {
   uint8_t count = 0;
   for (int i = -1; i < 2; i++) {
     for (int j = -1; j < 2; j++) {
       if ((i == 0 && j == 0) || out_of_bounds(x + i, y + j)) {
         continue;
-      } else if (area[x + i][y + j] == true) {
+      } else if (cell(x + i, y + j) == true) {
         count++;
       }
     }
@@ -783,9 +1955,9 @@ uint8_t GameOfLife::live_neighbors(uint8_t x, uint8_t y) {
   return count;
 }
 
-bool GameOfLife::alive(uint8_t x, uint8_t y) {
+bool GameOfLife::alive(led_coord_t x, led_coord_t y) {
   uint8_t live_n = live_neighbors(x, y);
-  bool status = area[x][y];
+  bool status = cell(x, y);
   // Any live cell with two or three live neighbours survives
   if (status == true && (live_n == 2 || live_n == 3)) {
     return true;
@@ -802,38 +1974,333 @@ bool GameOfLife::alive(uint8_t x, uint8_t y) {
 }
 
 void GameOfLife::generation() {
-  for (int x = 0; x < width; x++) {
+  generation(0, width);
+}
+
+/*
+Step a range of columns forward one generation.
+
+Columns outside the range are treated as empty so separate ranges of the
+board evolve independently of each other.
+
+@param first First column to update
+@param count Number of columns to update
+*/
+void GameOfLife::generation(uint8_t first, uint8_t count) {
+  first_column = first;
+  end_column = first + count;
+  for (int x = first; x < end_column; x++) {
+    uint32_t* next = area + x * stride + words;
+    memset(next, 0, words * sizeof(uint32_t));
     for (int y = 0; y < height; y++) {
       if (alive(x, y) == true) {
-        area_n[x][y] = true;
-      } else {
-        area_n[x][y] = false;
+        next[y / 32] |= 1UL << (y % 32);
       }
     }
   }
   copy_area();
 }
 
+void LED_Bars::enter_life() {
+  game_of_life.random_board(segment_offset, active_segments);
+}
+
 void LED_Bars::life() {
+  if (pattern_state == NULL) {
+    fill();
+    return;
+  }
   uint16_t alive_count = 0;
-  bool generate = millis() - last_time > 100;
-  for (int x = 0; x < game_of_life.width; x++) {
+  bool generate = led_time() - last_time > 100;
+  for (int x = 0; x < active_segments; x++) {
     for (int y = 0; y < game_of_life.height; y++) {
-      if (game_of_life.area[x][y] == true) {
+      if (game_of_life.cell(segment_offset + x, y) == true) {
         alive_count++;
         set_led_color(x, y, color(y, x, 0), 125);
       }
     }
   }
   if (generate) {
-    last_time = millis();
-    game_of_life.generation();
+    last_time = led_time();
+    game_of_life.generation(segment_offset, active_segments);
+  }
+  // Restart once the board has mostly died out, about 5 cells per segment
+  if (alive_count <= 5 * active_segments) {
+    game_of_life.random_board(segment_offset, active_segments);
+  }
+}
+
+/*
+Show frames streamed from a host, falls back to `fill` without a frame source.
+
+Frames are segment by segment from the first led of each segment, any leds beyond
+the active segments are read and ignored. When this is the only pattern running
+`render()` keeps the previous frame up and only shows complete frames, as part of a
+zone or transition the buffer is cleared every frame so partial frames can show.
+*/
+void LED_Bars::external_frames() {
+#ifdef LED_INDEXED
+  // Streamed frames are full color, indexed frames can't hold them
+  fill();
+  return;
+#endif
+  if (frame_source == NULL) {
+    fill();
+    return;
+  }
+  ingest_frames();
+}
+
+/*
+Draw a noise field over the active segments.
+
+Noise is only evaluated every `LED_NOISE_STEP` leds along a segment, the leds in between
+are interpolated, which is what keeps a whole frame within budget on AVR. Segments are
+spaced three leds apart in the field since bars are usually further apart than their leds.
+
+@param scale Noise units per led, 256 is a whole lattice cell
+@param z Position along the time axis
+@param shift Offset along the segments, moving it moves the field up or down
+@param color_by_value Pick the color by the noise value instead of the led position
+@param shape_func Turns a noise value into a brightness
+*/
+void LED_Bars::noise_field(
+  uint16_t scale, uint16_t z, uint16_t shift, bool color_by_value,
+  uint8_t (*shape_func)(uint8_t value)
+  ) {
+  for (int i = 0; i < active_segments; i++) {
+    uint16_t x = (segment_offset + i) * scale * 3;
+    uint8_t from = noise8(x, shift, z);
+    for (led_coord_t j = 0; j < led_per_segment; j += LED_NOISE_STEP) {
+      uint8_t to = noise8(x, shift + (j + LED_NOISE_STEP) * scale, z);
+      for (uint8_t k = 0; k < LED_NOISE_STEP && j + k < led_per_segment; k++) {
+        uint8_t value = lerp8(from, to, k * (256 / LED_NOISE_STEP));
+        int pos = color_by_value == true ? ((uint16_t)value * led_per_segment) >> 8 : j + k;
+        set_led_color(i, j + k, color(pos, i, 0), shape_func(value));
+      }
+      from = to;
+    }
+  }
+}
+
+static uint8_t plasma_shape(uint8_t value) {
+  return 30 + (value >> 1);
+}
+
+// Soft clouds over a dim sky
+static uint8_t cloud_shape(uint8_t value) {
+  return value < 96 ? 10 : 10 + ((value - 96) * 115) / 159;
+}
+
+// Only the hottest parts glow, with hard edges like blobs of lava
+static uint8_t lava_shape(uint8_t value) {
+  return value < 140 ? 0 : min((value - 140) * 4, 125);
+}
+
+// Swirling color across the whole matrix, the selected colors are mapped over the noise
+void LED_Bars::plasma() {
+  noise_field(40, led_time() / 4, 0, true, plasma_shape);
+}
+
+// Large, slowly changing clouds drifting along the segments
+void LED_Bars::clouds() {
+  unsigned long time = led_time();
+  noise_field(24, time / 16, time / 8, false, cloud_shape);
+}
+
+// Blobs that slowly change shape while rising
+void LED_Bars::lava() {
+  unsigned long time = led_time();
+  noise_field(48, time / 12, -(time / 6), true, lava_shape);
+}
+
+// Fires start out cold and build up from the sparks
+void LED_Bars::enter_fire() {
+  for (int i = 0; i < active_segments; i++) {
+    memset(pattern_state + (segment_offset + i) * state_stride, 0, led_per_segment);
+  }
+}
+
+/*
+Flames rising from the bottom of every segment.
+
+Each segment is a column of heat that cools a little every step, drifts upward by blending
+each cell with the two below it, and gets random sparks near the base. Everything works in
+place on one byte a led. Heat picks the color from the selected color like a gradient, so
+the `heat` color gives a classic fire and others give flames in their own colors.
+*/
+void LED_Bars::fire() {
+  if (pattern_state == NULL) {
+    fill();
+    return;
   }
-  if (alive_count <= 20) {
-    game_of_life.random_board();
+
+  // Steps are about 60 a second however fast frames are drawn
+  bool step = led_time() - last_time >= 16;
+  if (step == true) {
+    last_time = led_time();
+  }
+  // Short segments cool faster, capped so a cell can still cool by a whole byte at most
+  uint16_t cooling_range = (uint16_t)LED_FIRE_COOLING * 10 / led_per_segment + 2;
+  uint8_t max_cooling = min(cooling_range, (uint16_t)255);
+
+  for (int i = 0; i < active_segments; i++) {
+    uint8_t* column = (uint8_t*)(pattern_state + (segment_offset + i) * state_stride);
+    if (step == true) {
+      uint32_t noise = 0;
+      for (led_coord_t j = 0; j < led_per_segment; j++) {
+        // Four cells of cooling out of each random number
+        if ((j & 3) == 0) {
+          noise = particle_rng.next();
+        }
+        uint8_t cooling = ((noise & 0xFF) * max_cooling) >> 8;
+        noise >>= 8;
+        column[j] = column[j] > cooling ? column[j] - cooling : 0;
+      }
+
+      // Heat drifts up, the top is updated first so every cell still reads the cells below as they were
+      for (led_coord_t j = led_per_segment - 1; j >= 2; j--) {
+        column[j] = ((uint16_t)(column[j - 1] + 2 * column[j - 2]) * 85) >> 8;
+      }
+
+      if (particle_rng.below(256) < LED_FIRE_SPARKING) {
+        led_coord_t j = particle_rng.below(min(led_per_segment, 7));
+        uint16_t spark = column[j] + particle_rng.range(160, 256);
+        column[j] = min(spark, 255);
+      }
+    }
+
+    // Cell 0 is the base, at the bottom of the segment
+    for (led_coord_t j = 0; j < led_per_segment; j++) {
+      uint8_t temperature = column[j];
+      int pos = ((uint16_t)temperature * led_per_segment) >> 8;
+      set_led_color(i, led_per_segment - 1 - j, color(pos, i, 0), min(temperature, 125));
+    }
   }
 }
 
+/*
+Test card for tuning calibration, the same on every segment so strips can be compared
+side by side. From the top, white in four steps that should look neutral and evenly spaced
+once calibrated, full red, green and blue, and orange where red and green mix, the part of
+the wheel uncalibrated strips show the least of. Ignores the selected color.
+*/
+void LED_Bars::calibration_card() {
+  uint32_t bands[8] = {
+    strip.gamma32(0xFFFFFF), strip.gamma32(0xBFBFBF), strip.gamma32(0x7F7F7F), strip.gamma32(0x3F3F3F),
+    0xFF0000, 0x00FF00, 0x0000FF, strip.gamma32(0xFF7F00),
+  };
+  for (int i = 0; i < active_segments; i++) {
+    for (led_coord_t j = 0; j < led_per_segment; j++) {
+      set_led_color(i, j, bands[((uint16_t)j * 8) / led_per_segment], 255);
+    }
+  }
+}
+
+// Run the loaded bytecode program, falls back to `fill` without one
+void LED_Bars::program() {
+  if (vm == NULL) {
+    fill();
+    return;
+  }
+  vm->run(*this);
+}
+
+// Point `ingest_pixel` at the first led of the segment being received
+void LED_Bars::ingest_segment_start() {
+  if (ingest_segment >= active_segments) {
+    ingest_pixel = NULL;
+    return;
+  }
+  segment seg = segments[segment_offset + ingest_segment];
+  ingest_pixel = strip.getPixels() + seg.first_position * 3;
+  ingest_step = seg.reverse == true ? -3 : 3;
+}
+
+/*
+Read whatever the frame source has buffered, writing pixel data straight into the strip.
+
+Returns true once a frame is complete and stops reading there so the next frame
+can't overwrite it before it's shown.
+*/
+bool LED_Bars::ingest_frames() {
+  // Adalight sends RGB, the strip buffer is GRB
+  static const uint8_t channel_offset[3] = { 1, 0, 2 };
+  bool complete = false;
+  int available = frame_source->available();
+
+  if (available <= 0) {
+    if (ingest_state != INGEST_A && millis() - ingest_time > LED_INGEST_TIMEOUT) {
+      frame_stats.dropped++;
+      ingest_state = INGEST_A;
+    }
+    return false;
+  }
+  ingest_time = millis();
+
+  int read = 0;
+  while (read < available && complete == false) {
+    uint8_t value = frame_source->read();
+    read++;
+    switch (ingest_state) {
+      case INGEST_A:
+        ingest_state = value == 'A' ? INGEST_D : INGEST_A;
+        break;
+      case INGEST_D:
+        ingest_state = value == 'd' ? INGEST_A2 : INGEST_A;
+        break;
+      case INGEST_A2:
+        ingest_state = value == 'a' ? INGEST_COUNT_HI : INGEST_A;
+        break;
+      case INGEST_COUNT_HI:
+        ingest_count = value << 8;
+        ingest_state = INGEST_COUNT_LO;
+        break;
+      case INGEST_COUNT_LO:
+        ingest_count |= value;
+        ingest_state = INGEST_CHECKSUM;
+        break;
+      case INGEST_CHECKSUM:
+        if (value != (highByte(ingest_count) ^ lowByte(ingest_count) ^ 0x55)) {
+          frame_stats.dropped++;
+          ingest_state = INGEST_A;
+          break;
+        }
+        ingest_received = 0;
+        ingest_segment = 0;
+        ingest_led = 0;
+        ingest_channel = 0;
+        ingest_segment_start();
+        ingest_state = INGEST_DATA;
+        break;
+      case INGEST_DATA:
+        if (ingest_pixel != NULL) {
+          ingest_pixel[channel_offset[ingest_channel]] = value;
+        }
+        if (++ingest_channel < 3) {
+          break;
+        }
+        ingest_channel = 0;
+        if (++ingest_led == led_per_segment) {
+          ingest_led = 0;
+          ingest_segment++;
+          ingest_segment_start();
+        } else if (ingest_pixel != NULL) {
+          ingest_pixel += ingest_step;
+        }
+        // The count is sent as leds minus one
+        if (ingest_received++ == ingest_count) {
+          frame_stats.frames++;
+          ingest_state = INGEST_A;
+          complete = true;
+        }
+        break;
+    }
+  }
+  frame_stats.bytes += read;
+  return complete;
+}
+
 // Color Functions
 
 /*
@@ -849,6 +2316,8 @@ The ColorHSV function is expecting a `uint16_t` so my hue values are split withi
 I split the led strips into 12 sections, one for each primary, secondary and tertiary color and displayed them in order.
 Most looked good but the red to yellow transitions showed little variation and that colors around blue were too blue.
 A bit of tuning and observation led to these numbers for an accurate color mapping for my leds.
+
+For differences between batches of strip see `set_calibration()`.
 */
 typedef struct Hues {
   uint16_t max_hue = 65535;
@@ -917,9 +2386,80 @@ uint32_t LED_Bars::vertical_partitions(int pos, uint16_t *color_set, uint16_t n_
   return strip.gamma32(strip.ColorHSV(*(color_set + partition)));
 }
 
+/*
+Map a vertical position to a color gradient that scrolls over time.
+
+Same as `vertical_gradient` but the position is offset by the per frame `frame_offset`
+so the gradient slowly moves along the segment. The first and last colors should match
+for the wrap around to be seamless.
+
+@param pos vertical position to map
+@param colorset[] array of color hues that define gradient points
+@param n_colors number of color values in the array
+
+@return gamma corrected, 32 bit packed color value
+*/
+uint32_t LED_Bars::scrolling_gradient(int pos, uint16_t color_set[], int n_colors) {
+  return vertical_gradient((pos + frame_offset) % led_per_segment, color_set, n_colors);
+}
+
+/*
+Evaluate anything about the current color that is the same for the whole frame.
+
+Frame colors and undrifted particle colors are computed once here instead of for every
+led, time based gradients get their scroll offset. Called by `render()` before the pattern.
+*/
+void LED_Bars::prepare_color() {
+  // Scroll time based gradients by one led every 50ms
+  frame_offset = (led_time() / 50) % led_per_segment;
+  // High frequencies push the hue around a little
+  frame_drift = audio != NULL ? audio->treble() * 8 : 0;
+
+  color_entry entry = colors[color_index];
+  if (entry.kind != COLOR_POSITION) {
+    frame_color = (this->*entry.func)(0, 0, frame_drift);
+  }
+#ifdef LED_INDEXED
+  prepare_palette();
+#endif
+}
+
+#ifdef LED_INDEXED
+/*
+Sample the selected color into the palette slots of the zone being drawn.
+
+Without zones the whole palette is spread along a segment. Zones each get an equal share
+of it, so every zone keeps its own color even though the frame only has one palette.
+*/
+void LED_Bars::prepare_palette() {
+  uint8_t slots = LED_PALETTE_SIZE;
+  palette_base = 0;
+  if (n_zones > 0) {
+    slots = max(LED_PALETTE_SIZE / n_zones, 1);
+    palette_base = (active_zone * slots) % LED_PALETTE_SIZE;
+  }
+  palette_step = (slots << 8) / led_per_segment;
+
+  for (uint8_t i = 0; i < slots; i++) {
+    // Each slot takes the color at the middle of the leds that map to it
+    int pos = ((2 * i + 1) * led_per_segment) / (2 * slots);
+    uint32_t color_value = color(pos, segment_offset, 0);
+    uint8_t* entry = palette[palette_base + i];
+    entry[0] = color_value >> 8;
+    entry[1] = color_value >> 16;
+    entry[2] = color_value;
+  }
+}
+#endif
+
+// General accessor function to get the currently selected color
 uint32_t LED_Bars::color(int pos, int seg, int drift) {
-  color_func color_f = colors[color_index];
-  return (this->*color_f)(pos, seg, drift);
+  PROFILE_SAMPLE(PROFILE_COLOR);
+  color_entry entry = colors[color_index];
+  if (entry.kind == COLOR_FRAME || (entry.kind == COLOR_PARTICLE && drift == 0)) {
+    return frame_color;
+  }
+  return (this->*entry.func)(pos, seg, drift + frame_drift);
 }
 
 uint32_t LED_Bars::red(int pos, int seg, int drift) {
@@ -1038,15 +2578,64 @@ uint32_t LED_Bars::teal_cyan_magenta(int pos, int seg, int drift) {
   return vertical_partitions(pos, colors, 3);
 }
 
-// TODO: Patterns appear faster when these are used and I'm not sure why
+// These only vary with time so they are registered as frame colors and evaluated
+// once per frame instead of for every led
 uint32_t LED_Bars::rainbow_shift(int pos, int seg, int drift) {
-  int hue = sawtooth_wave((100 / 2), 0.00001, millis(), (100 / 2));
+  int hue = sawtooth_wave((100 / 2), 0.00001, led_time(), (100 / 2));
   hue = map(hue, 0, 100, 0, color_hues.max_hue);
   return strip.gamma32(strip.ColorHSV(hue));
 }
 
 uint32_t LED_Bars::green_cyan_shift(int pos, int seg, int drift) {
-  int hue = triangle_wave((100 / 2), 0.000016, millis(), (100 / 2));
+  int hue = triangle_wave((100 / 2), 0.000016, led_time(), (100 / 2));
   hue = map(hue, 0, 100, color_hues.green, color_hues.cyan);
   return strip.gamma32(strip.ColorHSV(hue));
 }
+
+uint32_t LED_Bars::rainbow_scroll(int pos, int seg, int drift) {
+  uint16_t colors[3] = { 0, color_hues.max_hue / 2, color_hues.max_hue };
+  return scrolling_gradient(pos, colors, 3);
+}
+
+uint32_t LED_Bars::fire_scroll(int pos, int seg, int drift) {
+  uint16_t colors[5] = {
+    color_hues.red, color_hues.orange, color_hues.yellow, color_hues.orange, color_hues.red
+  };
+  return scrolling_gradient(pos, colors, 5);
+}
+
+/*
+Black body colors from black through red and yellow to white, as RGB.
+
+Flash resident and sampled between entries, `heat` maps it along a segment like a gradient.
+*/
+static const uint8_t heat_palette[9][3] PROGMEM = {
+  { 0, 0, 0 },
+  { 64, 0, 0 },
+  { 128, 0, 0 },
+  { 192, 16, 0 },
+  { 255, 48, 0 },
+  { 255, 96, 0 },
+  { 255, 160, 0 },
+  { 255, 224, 32 },
+  { 255, 255, 160 },
+};
+
+uint32_t LED_Bars::heat(int pos, int seg, int drift) {
+  // Position out of 256 along the 8 steps between palette entries
+  uint16_t scaled = min(((uint32_t)pos << 11) / led_per_segment, (uint32_t)2047);
+  uint8_t index = scaled >> 8;
+  uint8_t amount = scaled;
+  uint8_t rgb[3];
+  for (uint8_t c = 0; c < 3; c++) {
+    rgb[c] = lerp8(pgm_read_byte(&heat_palette[index][c]), pgm_read_byte(&heat_palette[index + 1][c]), amount);
+  }
+  return strip.Color(rgb[0], rgb[1], rgb[2]);
+}
+
+uint32_t LED_Bars::ocean_scroll(int pos, int seg, int drift) {
+  uint16_t colors[4] = {
+    color_hues.blue, color_hues.teal, color_hues.cyan, color_hues.blue
+  };
+  return scrolling_gradient(pos, colors, 4);
+}
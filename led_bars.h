@@ -11,9 +11,91 @@ of `segment` types. These define how the strips/segments are connected.
 
 #include "Arduino.h"
 #include "Adafruit_NeoPixel.h"
+#include "led_settings.h"
+#include "led_audio.h"
+#include "led_profile.h"
+#include "led_vm.h"
+#include "led_indexed.h"
+#include "led_calibration.h"
+
+#ifdef __AVR__
+ #include <avr/sleep.h>
+#endif
 
+/*
+  Geometry used to size the storage of a plain `LED_Bars`, by default the 4 segments of 60
+  leds the examples are wired for. Sketches using `LED_Matrix` get storage sized by its
+  template arguments instead, but `LED_PER_SEGMENT` still decides the width of led
+  coordinates the library is built with.
+*/
 #ifndef LED_SEGMENTS
-#define LED_SEGMENTS 1
+#define LED_SEGMENTS 4
+#endif
+
+#ifndef LED_PER_SEGMENT
+#define LED_PER_SEGMENT 60
+#endif
+
+#if LED_SEGMENTS > 255
+#error "LED_SEGMENTS must be 255 or less"
+#endif
+
+#if LED_SEGMENTS * LED_PER_SEGMENT > 65535
+#error "LED_SEGMENTS * LED_PER_SEGMENT must fit a 16 bit led index"
+#endif
+
+// Smallest type that can address every led along a segment
+#if LED_PER_SEGMENT > 256
+typedef uint16_t led_coord_t;
+#else
+typedef uint8_t led_coord_t;
+#endif
+
+// Position along a segment in 1/256ths of a led, see `set_led_color_subpixel()`
+#if LED_PER_SEGMENT > 256
+typedef uint32_t led_subpixel_t;
+#else
+typedef uint16_t led_subpixel_t;
+#endif
+
+// Sleep mode used by `sleep()`, idle keeps timers and serial running at a higher draw
+#if defined(__AVR__) && !defined(LED_SLEEP_MODE)
+#define LED_SLEEP_MODE SLEEP_MODE_PWR_DOWN
+#endif
+
+// With indexed frames on AVR leds are sent from `cells` and the strip never allocates a buffer
+#if defined(LED_INDEXED) && defined(__AVR__)
+#define LED_STRIP_LEDS(count) 0
+#else
+#define LED_STRIP_LEDS(count) (count)
+#endif
+
+// Heat lost per step, higher makes shorter flames
+#ifndef LED_FIRE_COOLING
+#define LED_FIRE_COOLING 55
+#endif
+
+// Chance out of 256 of a new spark each step, higher makes a busier fire
+#ifndef LED_FIRE_SPARKING
+#define LED_FIRE_SPARKING 120
+#endif
+
+// Maximum number of zones, each zone needs at least one segment
+#ifndef LED_ZONES
+#define LED_ZONES LED_SEGMENTS
+#endif
+
+/*
+  Built with `-DLED_REGISTRY` the pattern and color tables only hold what the sketch adds
+  with `add_pattern()` and `add_color()`, or sets, so everything else is left out of the
+  image. These are the most each table can hold.
+*/
+#ifndef LED_REGISTRY_PATTERNS
+#define LED_REGISTRY_PATTERNS 8
+#endif
+
+#ifndef LED_REGISTRY_COLORS
+#define LED_REGISTRY_COLORS 8
 #endif
 
 // Default amount of particles for various animations
@@ -35,6 +117,34 @@ typedef struct Segment {
   bool reverse;
 } segment;
 
+/*
+  Color functions are sorted by what their output actually varies with so the
+  renderer can skip work. A frame color is the same for every led in a frame
+  (time animated solid colors), a particle color only changes with the hue drift
+  of a particle and a position color depends on where the led is. Frame colors,
+  and particle colors without drift, are evaluated once per frame in `render()`
+  and the cached value is handed out for every led.
+*/
+enum color_kind {
+  COLOR_FRAME,
+  COLOR_PARTICLE,
+  COLOR_POSITION,
+};
+
+/*
+  A zone is a range of neighbouring segments that runs its own pattern and color.
+  Particles are stored per segment so zones never share them, the timing state
+  a pattern keeps between frames is stored with the zone.
+*/
+typedef struct Zone {
+  uint8_t first_segment;
+  uint8_t n_segments;
+  uint8_t pattern_index;
+  uint8_t color_index;
+  int prev_seg = -1;
+  unsigned long last_time = 0;
+} zone;
+
 typedef struct Particle {
   unsigned int position = 0;
   unsigned long start_time = 0;
@@ -44,6 +154,56 @@ typedef struct Particle {
 } particle;
 
 
+/*
+  Small xorshift random number generator.
+
+  Arduino's `random()` and C's `rand()` share a single global sequence and are slow on avr,
+  each subsystem instead owns one of these streams so patterns can be seeded independently
+  and replayed exactly. The bounded helpers avoid division by scaling the top 16 bits.
+*/
+class Rng {
+
+private:
+  uint32_t state = 1;
+
+public:
+  Rng(uint32_t seed_value = 1, uint8_t stream = 0) {
+    seed(seed_value, stream);
+  };
+
+  void seed(uint32_t seed_value, uint8_t stream = 0);
+  uint32_t next();
+  uint16_t frac16();
+  uint16_t below(uint16_t bound);
+  int range(int min, int max);
+  float float_range(float min, float max);
+};
+
+// Stream ids used to derive independent sequences from a single seed
+enum rng_stream {
+  RNG_CONTROL,
+  RNG_SPARKLES,
+  RNG_PARTICLES,
+  RNG_SNAKES,
+  RNG_LIFE,
+};
+
+/*
+Clock every animation is timed from, `millis()` unless replaced. Setting a clock lets frames be
+rendered at simulated times, faster than real time or repeatably from the same seed. Timing
+that deals with the outside world, settings writes, inputs, audio and frame ingest, stays on `millis()`.
+*/
+typedef unsigned long (*led_clock_func)();
+void set_led_clock(led_clock_func clock);
+unsigned long led_time();
+
+/*
+Called by `sleep()` in place of sleeping on boards without AVR sleep modes, returning is
+the wake up. Without one `sleep()` returns straight away.
+*/
+typedef void (*led_sleep_func)();
+void set_led_sleep(led_sleep_func func);
+
 // Math helpers
 
 int sine_wave(int amp, float freq, long time, int offset);
@@ -53,46 +213,66 @@ int rev_sawtooth_wave(int amp, float freq, long time, int offset);
 
 void inc_value(uint8_t* value, int max, int step = 1, bool clamp = false, int wrap = 0);
 void dec_value(uint8_t* value, int min, int step = 1, bool clamp = false, int wrap = 0);
-
-bool is_in(int val, particle arr[]);
-float float_rand( float min, float max);
-
-int moving_calc(unsigned long time, int count, float vel);
-int upward_calc(unsigned long time, int count, float vel);
-int falling_calc(unsigned long time, int count, float vel);
-int rising_calc(unsigned long time, int count, float vel);
-int falling_calc_rand(unsigned long time, int count, float vel);
-int rising_calc_rand(unsigned long time, int count, float vel);
+uint8_t lerp8(uint8_t from, uint8_t to, uint8_t amount);
+void scale_bytes(uint8_t* bytes, uint16_t count, uint8_t amount);
+
+bool is_in(int val, particle arr[], int count);
+
+// Particle positions, in 1/256ths of a led
+long moving_calc(unsigned long time, int count, float vel);
+long upward_calc(unsigned long time, int count, float vel);
+long falling_calc(unsigned long time, int count, float vel);
+long rising_calc(unsigned long time, int count, float vel);
+long falling_calc_rand(unsigned long time, int count, float vel);
+long rising_calc_rand(unsigned long time, int count, float vel);
 int gen_seg(int n_segments);
 
+// Words needed for one column of the game of life board, 32 cells per word
+#define LIFE_WORDS(height) (((height) + 31) / 32)
+
 class GameOfLife {
 
 private:
-  bool area_n[4][60];
+  /*
+  Cells are bit packed per column, bit `y % 32` of word `x * stride + y / 32`. Each column
+  holds the current board followed by the next one, `words` further on.
+  */
+  uint16_t stride;
+  uint8_t words;
+
+  // Columns updated by the current generation, anything outside is treated as empty
+  uint8_t first_column = 0;
+  uint8_t end_column = 0;
 
-  bool out_of_bounds(uint8_t x, uint8_t y);
+  bool out_of_bounds(led_coord_t x, led_coord_t y);
   void copy_area();
-  uint8_t live_neighbors(uint8_t x, uint8_t y);
-  bool alive(uint8_t x, uint8_t y);
+  uint8_t live_neighbors(led_coord_t x, led_coord_t y);
+  bool alive(led_coord_t x, led_coord_t y);
 
 public:
   uint8_t width;
-  uint8_t height;
-  bool area[4][60];
+  led_coord_t height;
+  uint32_t* area = NULL;
+  Rng rng;
 
-  GameOfLife(uint8_t w, uint8_t h) {
+  GameOfLife(uint8_t w, led_coord_t h) : rng(1, RNG_LIFE) {
     width = w;
     height = h;
-    random_board();
+    words = LIFE_WORDS(h);
   };
 
+  // Columns of at least `2 * LIFE_WORDS(h)` words, `column_words` apart
+  void attach(uint32_t* board, uint16_t column_words);
+  bool cell(led_coord_t x, led_coord_t y);
   void generation();
+  void generation(uint8_t first, uint8_t count);
   void random_board();
+  void random_board(uint8_t first, uint8_t count);
 };
 
 typedef struct Point {
-  uint8_t x;
-  uint8_t y;
+  led_coord_t x;
+  led_coord_t y;
 } point;
 
 typedef struct Snake {
@@ -103,65 +283,172 @@ typedef struct Snake {
   point points[];
 } snake;
 
+// Moves a snake looks ahead when picking its next step, bounds the time a move can take
+#ifndef LED_SNAKE_LOOKAHEAD
+#define LED_SNAKE_LOOKAHEAD 16
+#endif
+
 class Snakes {
 private:
+  /*
+  Bitboards for scoring moves, packed per column like the game of life, bit `y % 32` of
+  word `x * stride + y / 32`. `free_cells` is every cell no snake is on and `reached` the
+  cells a flood fill has got to.
+  */
+  uint32_t* free_cells = NULL;
+  uint32_t* reached = NULL;
+  uint16_t stride;
+  uint8_t words;
+
   bool point_collision(point pnt);
   bool valid_point(point pnt);
   point* adjacent_points(point pnt);
+  void mark_free_cells();
+  uint16_t reachable_area(point start, uint16_t enough);
 
 public:
   uint8_t width;
-  uint8_t height;
-  const uint8_t snake_count = 1;
-  snake* snake_insts[1];
-
-  Snakes(uint8_t w, uint8_t h) {
+  led_coord_t height;
+  // One snake per zone, each only exists while its zone shows snakes
+  uint8_t snake_count;
+  snake** snake_insts;
+  Rng rng;
+  // Snakes that were stuck with nowhere to move and started again
+  uint16_t respawns = 0;
+
+  // Columns snakes are currently allowed to move in
+  uint8_t first_column = 0;
+  uint8_t end_column;
+
+  Snakes(uint8_t w, led_coord_t h, snake** insts, uint8_t count) : rng(1, RNG_SNAKES) {
     width = w;
     height = h;
+    words = LIFE_WORDS(h);
+    snake_insts = insts;
+    snake_count = count;
+    end_column = w;
     for (int i = 0; i < snake_count; i++) {
-      snake_insts[i] = create_snake();
+      snake_insts[i] = NULL;
     }
   }
 
+  // Columns of at least `2 * LIFE_WORDS(h)` words, `column_words` apart, needed before moving
+  void attach(uint32_t* boards, uint16_t column_words);
+  void set_bounds(uint8_t first, uint8_t count);
+
   void move_snake(uint8_t index);
   snake* create_snake();
   void remove_snake(uint8_t index);
 };
 
+/*
+  Storage for everything in `LED_Bars` that is sized by the geometry. A plain `LED_Bars`
+  points this at buffers sized by `LED_SEGMENTS`, `LED_Matrix` at its own exactly sized ones.
+*/
+typedef struct Storage {
+  segment* segments;
+  particle (*particles)[LED_PARTICLES];
+  zone* zones;
+  uint8_t max_zones;
+  snake** snakes;
+} led_storage;
+
+// Adalight frames, "Ada" then the led count minus one and a checksum, then RGB per led
+enum ingest_phase {
+  INGEST_A, INGEST_D, INGEST_A2, INGEST_COUNT_HI, INGEST_COUNT_LO, INGEST_CHECKSUM, INGEST_DATA
+};
+
+// Milliseconds without a byte before a partial frame is dropped
+#ifndef LED_INGEST_TIMEOUT
+#define LED_INGEST_TIMEOUT 100
+#endif
+
+typedef struct IngestStats {
+  unsigned long bytes = 0;
+  unsigned long frames = 0;
+  // Frames with a bad header or that stopped part way through
+  unsigned long dropped = 0;
+} ingest_stats;
+
+class LED_Input;
+
 class LED_Bars {
 
+  // Programs draw through the same private helpers the built in patterns use
+  friend class LED_VM;
+
 private:
 
   typedef uint32_t (LED_Bars::*color_func)(int, int, int);
   typedef void (LED_Bars::*pattern_func)();
 
+  typedef struct ColorEntry {
+    color_func func;
+    uint8_t kind;
+  } color_entry;
+
+  /*
+  Patterns that keep state between frames set it up in `enter` and release it in `exit`,
+  both called with the segments of the zone or whole strip the pattern is starting or
+  stopping on. `exit` can be NULL.
+  */
+  typedef struct PatternHooks {
+    pattern_func func;
+    pattern_func enter;
+    pattern_func exit;
+  } pattern_hooks;
+
   Adafruit_NeoPixel strip;
   bool is_off = true;
+  // False if the geometry given didn't fit the storage and was cut down
+  bool geometry_fits = true;
+  unsigned long frame_count = 0;
   bool vertical = true;
 
   GameOfLife game_of_life;
   Snakes snakes;
 
-  // Member arrays have to be intiailized with a fixed static var
-  segment segments[LED_SEGMENTS];
+  segment* segments;
 
   uint8_t color_hue = 0;
-  int color_hue_addr = 0;
-
   uint8_t brightness = 55;
-  int brightness_addr = 3;
+  LED_Settings settings;
+
+  // Optional sound input, patterns that react to it fall back to their timing without one
+  LED_Audio* audio = NULL;
+
+  // Bytecode run by the `program` pattern
+  LED_VM* vm = NULL;
 
-  unsigned int map_to_position(uint8_t x, uint8_t y);
+  unsigned int map_to_position(led_coord_t x, led_coord_t y);
   uint32_t vertical_gradient(int pos, uint16_t color_set[], int n_colors);
   uint32_t vertical_partitions(int pos, uint16_t *color_set, uint16_t n_colors);
-  void cycle_particles(unsigned int active_seg, bool no_gen, bool glow, bool hue_drift, int (*pos_func)(unsigned long time, int count, float vel));
+  uint32_t scrolling_gradient(int pos, uint16_t color_set[], int n_colors);
+  void cycle_particles(unsigned int active_seg, bool no_gen, bool glow, bool hue_drift, long (*pos_func)(unsigned long time, int count, float vel));
   uint32_t from_hue(uint16_t hue, int drift);
   void calc_bounce(int n_waves, float freq, bool drift, int (*pos_func)(int amp, float freq, long time, int offset));
   void cycle_sparkles(bool drift);
+  void noise_field(uint16_t scale, uint16_t z, uint16_t shift, bool color_by_value, uint8_t (*shape_func)(uint8_t value));
 
-  particle particles[LED_SEGMENTS][LED_PARTICLES];
+  Rng control_rng = Rng(1, RNG_CONTROL);
+  Rng sparkle_rng = Rng(1, RNG_SPARKLES);
+  Rng particle_rng = Rng(1, RNG_PARTICLES);
+
+  particle (*particles)[LED_PARTICLES];
+
+  // The segments the current pattern renders to, either every segment or a single zone
+  uint8_t segment_offset = 0;
+  uint8_t active_segments;
+  uint8_t active_zone = 0;
+
+  zone* zones;
+  uint8_t max_zones;
+  uint8_t n_zones = 0;
+  void render_zones();
+  uint8_t pattern_lookup(pattern_func func);
+  uint8_t color_lookup(color_func func);
   int prev_seg = -1;
-  unsigned long last_time = millis();
+  unsigned long last_time = led_time();
   const int particle_count = LED_PARTICLES;
 
   /*
@@ -171,7 +458,12 @@ private:
   To not duplicate this value I just compute the number of patterns
   based on this array size.
   */
-  pattern_func patterns[19] = {
+#ifdef LED_REGISTRY
+  // Only what the sketch adds, `fill` and `red` are always there as the first entries
+  pattern_func patterns[LED_REGISTRY_PATTERNS] = { &fill };
+  int num_patterns = 1;
+#else
+  pattern_func patterns[26] = {
     &fill,
     &glow,
     &sparkles,
@@ -191,72 +483,213 @@ private:
     &rising_drift_sparkle_waves,
     &moving_snakes,
     &life,
+    &external_frames,
+    &program,
+    &plasma,
+    &clouds,
+    &lava,
+    &fire,
+    &calibration_card,
   };
   int num_patterns = sizeof(patterns) / sizeof(patterns[0]);
+#endif
+#ifdef LED_PROFILE
+  static_assert(sizeof(patterns) / sizeof(patterns[0]) <= LED_PROFILE_PATTERNS,
+    "LED_PROFILE_PATTERNS must cover every pattern in the table");
+#endif
   uint8_t pattern_index = 0;
-  int pattern_index_addr = 1;
   void pattern();
 
+  /*
+  Only the few patterns with state have hooks, kept apart so the pattern table stays small.
+  A registry build starts with none and keeps the ones `add_pattern()` is given, so the
+  hooks of patterns a sketch doesn't add aren't linked either.
+  */
+#ifdef LED_REGISTRY
+  pattern_hooks stateful_patterns[3];
+  uint8_t num_stateful = 0;
+#else
+  pattern_hooks stateful_patterns[3] = {
+    { &moving_snakes, &enter_snakes, &exit_snakes },
+    { &life, &enter_life, NULL },
+    { &fire, &enter_fire, NULL },
+  };
+  uint8_t num_stateful = 3;
+#endif
+  const pattern_hooks* find_hooks(uint8_t index);
+  void enter_pattern(uint8_t index);
+  void exit_pattern(uint8_t index);
+
+  /*
+  State of whichever stateful pattern is showing on each segment, a column of `state_stride`
+  words per segment sized for the largest: two life or snake boards, or a byte of heat a
+  led. Allocated when one first starts and then kept, so patterns that come and go don't
+  fragment the heap.
+  */
+  uint32_t* pattern_state = NULL;
+  uint16_t state_stride = 0;
+  bool alloc_pattern_state();
+
   /*
   TODO: Using a dynamic array causes build errors and defining
   a const `num_colors` and using that with the array construct
   also causes build errors, static/const class members also fail.
   To not duplicate this value I just compute the number of colors based on the array size.
   */
-  color_func colors[24] = {
-    &red,
-    &vermillion,
-    &orange,
-    &amber,
-    &yellow,
-    &lime,
-    &green,
-    &teal,
-    &cyan,
-    &blue,
-    &violet,
-    &purple,
-    &pink,
-    &magenta,
-    &vibrant_red,
-    &rainbow,
-    &all_colors,
-    &red_green_blue,
-    &magenta_yellow_cyan,
-    &red_to_yellow,
-    &teal_to_purple,
-    &teal_cyan_magenta,
-    &blue_magenta_blue,
-    &green_cyan_shift,
+#ifdef LED_REGISTRY
+  color_entry colors[LED_REGISTRY_COLORS] = { { &red, COLOR_PARTICLE } };
+  int num_colors = 1;
+#else
+  color_entry colors[29] = {
+    { &red, COLOR_PARTICLE },
+    { &vermillion, COLOR_PARTICLE },
+    { &orange, COLOR_PARTICLE },
+    { &amber, COLOR_PARTICLE },
+    { &yellow, COLOR_PARTICLE },
+    { &lime, COLOR_PARTICLE },
+    { &green, COLOR_PARTICLE },
+    { &teal, COLOR_PARTICLE },
+    { &cyan, COLOR_PARTICLE },
+    { &blue, COLOR_PARTICLE },
+    { &violet, COLOR_PARTICLE },
+    { &purple, COLOR_PARTICLE },
+    { &pink, COLOR_PARTICLE },
+    { &magenta, COLOR_PARTICLE },
+    { &vibrant_red, COLOR_PARTICLE },
+    { &rainbow, COLOR_POSITION },
+    { &all_colors, COLOR_POSITION },
+    { &red_green_blue, COLOR_POSITION },
+    { &magenta_yellow_cyan, COLOR_POSITION },
+    { &red_to_yellow, COLOR_POSITION },
+    { &teal_to_purple, COLOR_POSITION },
+    { &teal_cyan_magenta, COLOR_POSITION },
+    { &blue_magenta_blue, COLOR_POSITION },
+    { &green_cyan_shift, COLOR_FRAME },
+    { &rainbow_shift, COLOR_FRAME },
+    { &rainbow_scroll, COLOR_POSITION },
+    { &fire_scroll, COLOR_POSITION },
+    { &ocean_scroll, COLOR_POSITION },
+    { &heat, COLOR_POSITION },
   };
   int num_colors = sizeof(colors) / sizeof(colors[0]);
+#endif
   uint8_t color_index = 0;
-  int color_index_addr = 2;
-  uint32_t color(int pos, int seg, int drift);
 
-public:
+  /*
+  Crossfade state. While a transition is running `transition_pixels` holds the last raw
+  frame of whichever pattern did not render this frame, the outgoing and incoming patterns
+  take turns so each frame still only runs a single pattern. The outgoing pattern keeps
+  its own particles and timers in `out_particles`, `out_prev_seg` and `out_last_time`,
+  swapped in around its turns. An outgoing pattern with state has already left, its last
+  frame is held instead. Both buffers are allocated by `set_transition()`.
+  */
+  uint16_t transition_duration = 0;
+  unsigned long transition_start = 0;
+  bool transitioning = false;
+  uint8_t* transition_pixels = NULL;
+  particle (*out_particles)[LED_PARTICLES] = NULL;
+  int out_prev_seg = -1;
+  unsigned long out_last_time = 0;
+  uint8_t out_pattern_index = 0;
+  uint8_t out_color_index = 0;
+  bool render_outgoing = false;
+  bool outgoing_held = false;
+  void change_pattern(uint8_t old_pattern, uint8_t old_color);
+  void render_transition();
+  void swap_outgoing_state();
+  void reset_state();
+
+  // Share of the previous frame kept under each new one, 0 clears every frame
+  uint8_t trail = 0;
+
+  // Leftover below one step of each led's green, red and blue, a nibble each, NULL without dithering
+  uint16_t* dither_error = NULL;
+  void clear_frame();
 
-  uint16_t n_segments;
-  uint16_t led_per_segment;
+  uint32_t color(int pos, int seg, int drift);
+  void show_frame();
+
+  // Curves for each segment, NULL sends frames as drawn, see led_calibration.h
+  const led_calibration* segment_calibration = NULL;
+  // Raw frame kept while boards without the AVR output calibrate the strip buffer
+  uint8_t* calibration_copy = NULL;
+  void show_calibrated();
+
+#ifdef LED_INDEXED
+  // One byte a led in strip order, see led_indexed.h
+  uint8_t* cells = NULL;
+  uint8_t palette[LED_PALETTE_SIZE][3];
+  // First slot of the colors being drawn and slots per led in 1/256ths
+  uint8_t palette_base = 0;
+  uint16_t palette_step = 0;
+  void prepare_palette();
+#endif
 
-  LED_Bars(uint16_t n_segs, uint16_t led_per_seg, uint16_t data_pin, segment* segs)
-    : strip(n_segs * led_per_seg, data_pin, NEO_GRB + NEO_KHZ800)
-    , game_of_life(n_segs, led_per_seg) 
-    , snakes(n_segs, led_per_seg) {
+  /*
+  External frame state, bytes are written straight into the strip buffer as they arrive
+  so `ingest_pixel` walks the current segment and steps to the next led.
+  */
+  Stream* frame_source = NULL;
+  pattern_func frames_pattern = NULL;
+  uint8_t ingest_state = INGEST_A;
+  uint16_t ingest_count = 0;
+  uint16_t ingest_received = 0;
+  uint8_t ingest_segment = 0;
+  led_coord_t ingest_led = 0;
+  uint8_t ingest_channel = 0;
+  uint8_t* ingest_pixel = NULL;
+  int8_t ingest_step = 0;
+  unsigned long ingest_time = 0;
+  void ingest_segment_start();
+  bool ingest_frames();
+
+  // Values shared by every led in a frame, see `prepare_color()`
+  uint32_t frame_color = 0;
+  uint16_t frame_offset = 0;
+  int frame_drift = 0;
+  void prepare_color();
+
+protected:
+
+  LED_Bars(uint16_t n_segs, uint16_t led_per_seg, uint16_t data_pin, const segment* segs, led_storage storage)
+    : strip(LED_STRIP_LEDS(n_segs * led_per_seg), data_pin, NEO_GRB + NEO_KHZ800)
+    , game_of_life(n_segs, led_per_seg)
+    , snakes(n_segs, led_per_seg, storage.snakes, storage.max_zones) {
     n_segments = n_segs;
     led_per_segment = led_per_seg;
+    active_segments = n_segs;
+    segments = storage.segments;
+    particles = storage.particles;
+    zones = storage.zones;
+    max_zones = storage.max_zones;
 
     segment *old = segments;
     for(int i = 0; i < n_segs; ++i)
         *old++ = *segs++;
   };
 
-  void begin();
+public:
+
+  uint16_t n_segments;
+  uint16_t led_per_segment;
+
+  /*
+  Storage is sized by `LED_SEGMENTS`, only that many segments are driven if there are more
+  and segments can't be longer than `led_coord_t` counts. `begin()` returns false when the
+  geometry had to be cut down to fit.
+  */
+  LED_Bars(uint16_t n_segs, uint16_t led_per_seg, uint16_t data_pin, segment* segs);
+
+  bool begin();
   void off();
+  void sleep(LED_Input* input = NULL);
   void render();
   void save_values();
   void load_values();
-  void set_led_color(uint8_t x, uint8_t y, uint32_t color_value, uint8_t bright);
+  void set_led_color(led_coord_t x, led_coord_t y, uint32_t color_value, uint8_t bright);
+  void add_led_color(led_coord_t x, led_coord_t y, uint32_t color_value, uint8_t bright);
+  void set_led_color_subpixel(led_coord_t x, led_subpixel_t y, uint32_t color_value, uint8_t bright);
+  uint32_t get_led_color(led_coord_t x, led_coord_t y);
 
   // Control functions
   void next_color();
@@ -268,8 +701,50 @@ public:
   void inc_brightness();
   void dec_brightness();
   void rand();
+  void seed(uint32_t value);
+  void restart_pattern();
   void set_pattern(pattern_func func);
   void set_color(color_func func);
+  bool add_pattern(pattern_func func, pattern_func enter = NULL, pattern_func exit = NULL);
+  bool add_color(color_func func, uint8_t kind = COLOR_POSITION);
+  bool set_pattern_index(uint8_t index);
+  bool set_color_index(uint8_t index);
+  void set_color_hue(uint8_t hue);
+  void set_brightness(uint8_t value);
+
+  // Current state, mostly for remote control and stats
+  uint8_t get_pattern_index();
+  uint8_t get_color_index();
+  uint8_t get_color_hue();
+  uint8_t get_brightness();
+  uint8_t get_num_patterns();
+  uint8_t get_num_colors();
+  unsigned long get_frame_count();
+  bool set_transition(uint16_t duration);
+  void set_decay(uint8_t amount);
+  bool set_dither(bool enable);
+  bool set_calibration(const led_calibration* per_segment);
+
+  // Sound that drives pattern motion and hue, NULL goes back to plain timing
+  void set_audio(LED_Audio* source);
+
+  // Program run by the `program` pattern, NULL falls back to `fill`
+  void set_program(LED_VM* program_vm);
+
+#ifdef LED_PROFILE
+  // Stage timings of recent frames, see led_profile.h
+  LED_Profile profile;
+#endif
+
+  // Frames for `external_frames`, NULL stops reading
+  void set_frame_source(Stream* source);
+  ingest_stats frame_stats;
+
+  // Zone functions
+  int add_zone(uint8_t first_seg, uint8_t n_segs, pattern_func pattern_f, color_func color_f);
+  void set_zone_pattern(uint8_t index, pattern_func func);
+  void set_zone_color(uint8_t index, color_func func);
+  void clear_zones();
 
   // Pattern functions
   void fill();
@@ -291,6 +766,19 @@ public:
   void rising_drift_sparkle_waves();
   void moving_snakes();
   void life();
+  void external_frames();
+  void program();
+  void plasma();
+  void clouds();
+  void lava();
+  void fire();
+  void calibration_card();
+
+  // Hooks of the patterns with state, only needed by `add_pattern()` in a registry build
+  void enter_life();
+  void enter_snakes();
+  void exit_snakes();
+  void enter_fire();
 
   // Color functions
   uint32_t red(int pos, int seg, int drift);
@@ -319,7 +807,64 @@ public:
   uint32_t teal_cyan_magenta(int pos, int seg, int drift);
   uint32_t green_cyan_shift(int pos, int seg, int drift);
   uint32_t blue_magenta_blue(int pos, int seg, int drift);
+  uint32_t rainbow_scroll(int pos, int seg, int drift);
+  uint32_t fire_scroll(int pos, int seg, int drift);
+  uint32_t ocean_scroll(int pos, int seg, int drift);
+  uint32_t heat(int pos, int seg, int drift);
+
+};
 
+/*
+  Exactly sized storage for a fixed geometry. Kept in its own base class so it is
+  constructed before `LED_Bars` starts filling it in.
+*/
+template <uint16_t Segments, uint16_t LedsPerSegment>
+class LED_Storage {
+
+protected:
+  segment storage_segments[Segments];
+  particle storage_particles[Segments][LED_PARTICLES];
+  zone storage_zones[Segments];
+  snake* storage_snakes[Segments];
+
+  led_storage storage() {
+    led_storage store = {
+      storage_segments, storage_particles, storage_zones, Segments, storage_snakes,
+    };
+    return store;
+  }
+};
+
+/*
+  An `LED_Bars` with its storage sized at compile time.
+
+  Every buffer is sized exactly for the geometry instead of by `LED_SEGMENTS`, which also
+  means the library no longer needs build flags to match the sketch. Geometries that can't
+  be addressed, and segment wiring arrays of the wrong length, are compile errors. Patterns
+  and output are shared by every geometry and compiled once, so their loops still run to
+  the runtime segment and led counts.
+
+    segment segments[4] = { ... };
+    LED_Matrix<4, 60> bars(LED_DATA_PIN, segments);
+*/
+template <uint16_t Segments, uint16_t LedsPerSegment>
+class LED_Matrix : private LED_Storage<Segments, LedsPerSegment>, public LED_Bars {
+
+  static_assert(Segments > 0 && LedsPerSegment > 0, "Geometry needs at least one led");
+  static_assert(Segments <= 0xFF, "Segments are indexed with 8 bits");
+  static_assert(LedsPerSegment - 1 <= (led_coord_t)~0,
+    "LedsPerSegment doesn't fit led_coord_t, build the library with a larger LED_PER_SEGMENT");
+  static_assert((uint32_t)Segments * LedsPerSegment <= 0xFFFF, "Too many leds for a 16 bit strip index");
+
+public:
+  static const uint16_t segment_count = Segments;
+  static const uint16_t leds_per_segment = LedsPerSegment;
+  static const uint16_t led_count = Segments * LedsPerSegment;
+
+  LED_Matrix(uint16_t data_pin, const segment (&segs)[Segments])
+    : LED_Storage<Segments, LedsPerSegment>()
+    , LED_Bars(Segments, LedsPerSegment, data_pin, segs, this->storage()) {
+  };
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "Arduino.h"
+#include "led_calibration.h"
+#include "led_send.h"
+#include "math.h"
+
+void calibrate_pixels(uint8_t* pixels, uint16_t count, const led_calibration* calibration) {
+  for (uint16_t i = 0; i < count; i++) {
+    for (uint8_t c = 0; c < 3; c++) {
+      *pixels = pgm_read_byte(calibration->curves[c] + *pixels);
+      pixels++;
+    }
+  }
+}
+
+// Value of a curve for a gain and gamma at one input, see `print_calibration()`
+uint8_t calibration_value(uint8_t input, float gain, float gamma) {
+  float value = gain * 255.0 * pow(input / 255.0, gamma) + 0.5;
+  return constrain(value, 0.0, 255.0);
+}
+
+/*
+Print a curve as a PROGMEM array to paste into a sketch.
+
+@param out Where to print, usually `Serial`
+@param name Name of the array
+@param gain Output at full input, below 1 dims a channel that is too strong for white balance
+@param gamma Bend of the curve on top of the library's own gamma correction, above 1 darkens
+the middle of the range and below 1 lifts it, 1 leaves it straight
+*/
+void print_calibration(Print& out, const char* name, float gain, float gamma) {
+  out.print("const uint8_t ");
+  out.print(name);
+  out.println("[256] PROGMEM = {");
+  for (uint16_t i = 0; i < 256; i++) {
+    out.print(i % 16 == 0 ? "  " : " ");
+    out.print(calibration_value(i, gain, gamma));
+    out.print(i % 16 == 15 ? ",\n" : ",");
+  }
+  out.println("};");
+}
+
+#ifdef LED_SEND_AVR
+
+// End of the last frame, the strip latches once the line has been low for 300us
+static unsigned long last_show = 0;
+
+/*
+Send a frame, looking each byte up in its segment's curves on the way out.
+
+The strip is sent as runs of leds, one per segment in the order they are wired, so the
+curves only change between runs. A lookup is a few cycles while the line is low between
+bytes, well inside the time the strip waits before latching.
+
+@param pin Data pin of the strip
+@param pixels Raw frame in strip order
+@param run_leds Leds in each run
+@param runs Number of runs
+@param run_calibrations Curves for each run
+*/
+void calibrated_show(uint8_t pin, const uint8_t* pixels, uint16_t run_leds, uint8_t runs, const led_calibration* const* run_calibrations) {
+  volatile uint8_t* port = portOutputRegister(digitalPinToPort(pin));
+  uint8_t mask = digitalPinToBitMask(pin);
+  while (micros() - last_show < 300) {
+  }
+
+  noInterrupts();
+  uint8_t hi = *port | mask;
+  uint8_t lo = *port & ~mask;
+  for (uint8_t r = 0; r < runs; r++) {
+    const uint8_t* green = run_calibrations[r]->curves[0];
+    const uint8_t* red = run_calibrations[r]->curves[1];
+    const uint8_t* blue = run_calibrations[r]->curves[2];
+    for (uint16_t i = 0; i < run_leds; i++) {
+      led_send_byte(port, hi, lo, pgm_read_byte(green + *pixels++));
+      led_send_byte(port, hi, lo, pgm_read_byte(red + *pixels++));
+      led_send_byte(port, hi, lo, pgm_read_byte(blue + *pixels++));
+    }
+  }
+  interrupts();
+  last_show = micros();
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+Per segment color calibration, applied to the frame while it is sent.
+
+Strips from different batches show the same values differently, one is greener, another has
+a blue that comes on late. A calibration is a curve for each channel, 256 bytes in flash that
+map what the library drew to what that strip needs to show it, so white balance and the shape
+of the response are a single lookup per channel. Segments point at the calibration of the
+strip they were cut from, segments from the same batch share one.
+
+The frame the patterns draw is never changed, so trails, crossfades and dithering keep working
+on uncalibrated values. On 16MHz AVR each byte is looked up while the previous one is still
+going out, other boards calibrate the buffer around `show()` and restore it from a copy.
+Indexed frames are sent from their palette and can't be calibrated.
+
+Curves are printed with `print_calibration()`, see `examples/calibration`, and pasted into
+the sketch:
+
+  const uint8_t warm_green[256] PROGMEM = { ... };
+  led_calibration batches[2] = { { warm_green, warm_red, warm_blue }, { ... } };
+  led_calibration per_segment[4] = { batches[0], batches[0], batches[1], batches[1] };
+  bars.set_calibration(per_segment);
+*/
+
+#ifndef led_calibration_h
+#define led_calibration_h
+
+#include "Arduino.h"
+
+typedef struct Calibration {
+  // Curves in flash for each byte of a led in the strip's order, green, red and blue
+  const uint8_t* curves[3];
+} led_calibration;
+
+// Look every byte of `count` leds up in the curves in place
+void calibrate_pixels(uint8_t* pixels, uint16_t count, const led_calibration* calibration);
+
+uint8_t calibration_value(uint8_t input, float gain, float gamma);
+void print_calibration(Print& out, const char* name, float gain, float gamma);
+
+#ifdef __AVR__
+void calibrated_show(uint8_t pin, const uint8_t* pixels, uint16_t run_leds, uint8_t runs, const led_calibration* const* run_calibrations);
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#include "Arduino.h"
+#include "led_indexed.h"
+#include "led_send.h"
+
+#ifdef LED_SEND_AVR
+
+// End of the last frame, the strip latches once the line has been low for 300us
+static unsigned long last_show = 0;
+
+/*
+Send a frame of palette indexed leds, expanding each one to GRB as it goes out.
+
+The expansion runs between bytes while the line is low, a couple of microseconds a led,
+well inside the time the strip waits before latching.
+
+@param pin Data pin of the strip
+@param cells Leds in strip order, see `indexed_cell()`
+@param count Number of leds
+@param palette Colors as GRB
+*/
+void indexed_show(uint8_t pin, const uint8_t* cells, uint16_t count, const uint8_t (*palette)[3]) {
+  volatile uint8_t* port = portOutputRegister(digitalPinToPort(pin));
+  uint8_t mask = digitalPinToBitMask(pin);
+  while (micros() - last_show < 300) {
+  }
+
+  noInterrupts();
+  uint8_t hi = *port | mask;
+  uint8_t lo = *port & ~mask;
+  for (uint16_t i = 0; i < count; i++) {
+    uint8_t cell = cells[i];
+    const uint8_t* color = palette[cell >> 4];
+    uint8_t level = indexed_level(cell);
+    led_send_byte(port, hi, lo, ((uint16_t)color[0] * level) >> 8);
+    led_send_byte(port, hi, lo, ((uint16_t)color[1] * level) >> 8);
+    led_send_byte(port, hi, lo, ((uint16_t)color[2] * level) >> 8);
+  }
+  interrupts();
+  last_show = micros();
+}
+
+#endif
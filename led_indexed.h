@@ -0,0 +1,51 @@
+/*
+Palette indexed frames, one byte per led instead of three, built with `-DLED_INDEXED`.
+
+Each led stores a 4 bit palette slot and a 4 bit level. The palette is sampled from the
+selected color every frame, split between zones when there are any, with the slots spread
+along a segment so gradients keep their shape in 16 steps. A led's slot comes from its
+position, so colors a pattern picks per led, like hue drift or a program's `OP_HUE`, are
+shown in the palette color at that height.
+
+On AVR the strip buffer is never allocated, `indexed_show()` expands each led to GRB
+while it is being sent. Other boards expand into the normal strip buffer before `show()`.
+Crossfades and streamed frames need full color and are turned off in this mode.
+*/
+
+#ifndef led_indexed_h
+#define led_indexed_h
+
+#include "Arduino.h"
+
+#define LED_PALETTE_SIZE 16
+
+#ifdef LED_INDEXED
+#if defined(__AVR__) && F_CPU != 16000000L
+#error "LED_INDEXED output is timed for a 16MHz AVR"
+#endif
+#endif
+
+// Pack a palette slot and a brightness out of 255 into a led
+inline uint8_t indexed_cell(uint8_t slot, uint8_t bright) {
+  return (slot << 4) | (bright >> 4);
+}
+
+// Brightness out of 255 of a led
+inline uint8_t indexed_level(uint8_t cell) {
+  return (cell & 0x0F) * 17;
+}
+
+// Expand a led to the GRB bytes the strip expects
+inline void indexed_expand(uint8_t cell, const uint8_t (*palette)[3], uint8_t* grb) {
+  const uint8_t* color = palette[cell >> 4];
+  uint8_t level = indexed_level(cell);
+  grb[0] = ((uint16_t)color[0] * level) >> 8;
+  grb[1] = ((uint16_t)color[1] * level) >> 8;
+  grb[2] = ((uint16_t)color[2] * level) >> 8;
+}
+
+#ifdef __AVR__
+void indexed_show(uint8_t pin, const uint8_t* cells, uint16_t count, const uint8_t (*palette)[3]);
+#endif
+
+#endif
@@ -0,0 +1,231 @@
+#include "Arduino.h"
+#include "led_input.h"
+
+// Interrupt handlers need a fixed target, only one input can be active
+static LED_Input* active_input = NULL;
+
+/*
+Quadrature decoding table indexed by the previous and current encoder state,
+`(prev_a, prev_b, a, b)`. Invalid jumps of both channels count as no movement.
+*/
+static const int8_t quad_table[16] = {
+  0, -1, 1, 0,
+  1, 0, 0, -1,
+  -1, 0, 0, 1,
+  0, 1, -1, 0,
+};
+
+void led_input_changed() {
+  if (active_input != NULL) {
+    active_input->pins_changed();
+  }
+}
+
+#ifdef __AVR__
+// Overridden by the definition in `LED_INPUT_ISR()` when the sketch has the handlers
+bool led_input_interrupts __attribute__((weak)) = false;
+
+static void enable_pin_change(uint8_t pin) {
+  *digitalPinToPCMSK(pin) |= bit(digitalPinToPCMSKbit(pin));
+  PCIFR |= bit(digitalPinToPCICRbit(pin));
+  PCICR |= bit(digitalPinToPCICRbit(pin));
+}
+#endif
+
+#ifndef __AVR__
+// Set by `begin()` when every pin could be attached to an interrupt
+static bool pins_attached = false;
+#endif
+
+// Are the pins decoded by interrupts rather than polled by `dispatch()`
+static bool using_interrupts() {
+#ifdef __AVR__
+  return led_input_interrupts;
+#else
+  return pins_attached;
+#endif
+}
+
+/*
+Start listening to a rotary encoder and its button.
+
+The encoder channels use the internal pullups, the button is expected to pull its
+pin low while pressed, matching the wiring of the knob control sketch.
+
+@param pin_a First encoder channel
+@param pin_b Second encoder channel
+@param pin_button Push button of the encoder
+*/
+void LED_Input::begin(uint8_t pin_a, uint8_t pin_b, uint8_t pin_button) {
+  pins[0] = pin_a;
+  pins[1] = pin_b;
+  pins[2] = pin_button;
+  pinMode(pin_a, INPUT_PULLUP);
+  pinMode(pin_b, INPUT_PULLUP);
+  pinMode(pin_button, INPUT);
+
+#ifdef __AVR__
+  for (uint8_t i = 0; i < 3; i++) {
+    pin_ports[i] = portInputRegister(digitalPinToPort(pins[i]));
+    pin_masks[i] = digitalPinToBitMask(pins[i]);
+  }
+#endif
+
+  quad_state = (read_pin(0) << 1) | read_pin(1);
+  button_down = read_pin(2) == false;
+  active_input = this;
+
+#ifdef __AVR__
+  // A pin change without a handler would jump to the reset vector
+  if (led_input_interrupts == false) {
+    return;
+  }
+  noInterrupts();
+  for (uint8_t i = 0; i < 3; i++) {
+    enable_pin_change(pins[i]);
+  }
+  interrupts();
+#else
+  pins_attached = false;
+  for (uint8_t i = 0; i < 3; i++) {
+    if (digitalPinToInterrupt(pins[i]) == NOT_AN_INTERRUPT) {
+      return;
+    }
+  }
+  for (uint8_t i = 0; i < 3; i++) {
+    attachInterrupt(digitalPinToInterrupt(pins[i]), led_input_changed, CHANGE);
+  }
+  pins_attached = true;
+#endif
+}
+
+bool LED_Input::read_pin(uint8_t index) {
+#ifdef __AVR__
+  return (*pin_ports[index] & pin_masks[index]) != 0;
+#else
+  return digitalRead(pins[index]) == HIGH;
+#endif
+}
+
+// Add an event to the queue from the interrupt, dropping it if the queue is full
+void LED_Input::push(uint8_t type) {
+  uint8_t next_head = (head + 1) & (LED_INPUT_QUEUE - 1);
+  if (next_head == tail) {
+    dropped++;
+    return;
+  }
+  queue[head].type = type;
+  queue[head].time = micros();
+  head = next_head;
+}
+
+/*
+Decode any change on the input pins, runs in interrupt context.
+
+Encoder transitions are accumulated until a full detent has turned. The button is
+debounced by ignoring edges too close to the last accepted one, a press is reported
+when it is released so its length can tell a long press apart.
+*/
+void LED_Input::pins_changed() {
+  uint8_t state = (read_pin(0) << 1) | read_pin(1);
+  if (state != quad_state) {
+    quad_count += quad_table[(quad_state << 2) | state];
+    quad_state = state;
+    if (quad_count >= LED_INPUT_STEPS) {
+      quad_count -= LED_INPUT_STEPS;
+      push(INPUT_ROTATE_CW);
+    } else if (quad_count <= -LED_INPUT_STEPS) {
+      quad_count += LED_INPUT_STEPS;
+      push(INPUT_ROTATE_CCW);
+    }
+  }
+
+  bool down = read_pin(2) == false;
+  unsigned long now = millis();
+  if (down != button_down && now - button_time > LED_INPUT_DEBOUNCE) {
+    if (down == false) {
+      push(now - button_time >= LED_INPUT_LONG_PRESS ? INPUT_LONG_PRESS : INPUT_PRESS);
+    }
+    button_down = down;
+    button_time = now;
+  }
+}
+
+// Events are matched against the table in order, every matching binding is applied
+void LED_Input::set_bindings(const input_binding* table, uint8_t count) {
+  bindings = table;
+  n_bindings = count;
+}
+
+// Take the oldest event off the queue, returns false when it is empty
+bool LED_Input::next(input_event* event) {
+  if (tail == head) {
+    return false;
+  }
+  event->type = queue[tail].type;
+  event->time = queue[tail].time;
+  tail = (tail + 1) & (LED_INPUT_QUEUE - 1);
+  return true;
+}
+
+/*
+Apply every queued event to the bars, call once per frame before `render()`.
+
+The pins are sampled again here when the interrupts can't be relied on for the current
+level. Without the handlers that's every frame. Otherwise it's once the debounce window
+after the last button edge is over, if the button level still differs. A release that
+bounced inside the window never sends another edge, and without this the button would
+stay down. Edges after the window are taken by the interrupt straight away, so a level
+that still differs here has been stable since its last edge.
+
+@param bars Target of the bound control functions
+
+@return Mask of every event type seen, see `INPUT_MASK`, so a sketch can react to
+events that aren't bound
+*/
+uint8_t LED_Input::dispatch(LED_Bars& bars) {
+  input_event event;
+  uint8_t seen = 0;
+
+  noInterrupts();
+  if (using_interrupts() == false
+      || ((read_pin(2) == false) != button_down && millis() - button_time > LED_INPUT_DEBOUNCE)) {
+    pins_changed();
+  }
+  interrupts();
+  while (next(&event) == true) {
+    for (uint8_t i = 0; i < n_bindings; i++) {
+      if (bindings[i].type == event.type) {
+        (bars.*bindings[i].action)();
+      }
+    }
+    seen |= INPUT_MASK(event.type);
+
+    last_latency = micros() - event.time;
+    if (last_latency > max_latency) {
+      max_latency = last_latency;
+    }
+  }
+  return seen;
+}
+
+void LED_Input::reset_latency() {
+  last_latency = 0;
+  max_latency = 0;
+}
+
+// Events lost because the queue was full, read with the interrupts off so the count can't tear
+uint16_t LED_Input::get_dropped() {
+  noInterrupts();
+  uint16_t count = dropped;
+  interrupts();
+  return count;
+}
+
+/*
+True with no queued events and the button up, the board can sleep until the next change.
+Always false while the pins are polled, nothing would wake the board.
+*/
+bool LED_Input::idle() {
+  return tail == head && button_down == false && using_interrupts() == true;
+}
@@ -0,0 +1,146 @@
+/*
+Interrupt driven input for a rotary encoder with a push button.
+
+Pin change interrupts decode the encoder and debounce the button, turning them into events
+on a small single producer, single consumer ring buffer. The interrupt only ever moves the
+head and the main loop only the tail, so neither side needs to block the other. Once per
+frame `dispatch()` drains the queue and applies events through a table of bindings to
+`LED_Bars` control functions.
+
+On AVR the pin change vectors are only defined by sketches that expand `LED_INPUT_ISR()`
+once at file scope, so the library never takes them from SoftwareSerial or other pin change
+users in sketches without an input. A sketch that already owns the vectors defines
+`bool led_input_interrupts = true;` itself and calls `led_input_changed()` from its handlers.
+Without either the pins are polled by `dispatch()` once per frame and the input can't wake
+the board from `sleep()`. Other boards attach an interrupt to each pin, or poll the same way
+if any of the pins has no interrupt.
+
+  LED_Input input;
+  LED_INPUT_ISR()
+*/
+
+#ifndef led_input_h
+#define led_input_h
+
+#include "Arduino.h"
+#include "led_bars.h"
+
+// Size of the event queue, must be a power of two
+#ifndef LED_INPUT_QUEUE
+#define LED_INPUT_QUEUE 8
+#endif
+
+// Button edges closer than this are bounce and ignored, in ms
+#ifndef LED_INPUT_DEBOUNCE
+#define LED_INPUT_DEBOUNCE 50
+#endif
+
+// Presses held at least this long are long presses, in ms
+#ifndef LED_INPUT_LONG_PRESS
+#define LED_INPUT_LONG_PRESS 800
+#endif
+
+// Quadrature transitions per detent of the encoder
+#ifndef LED_INPUT_STEPS
+#define LED_INPUT_STEPS 4
+#endif
+
+enum input_type {
+  INPUT_ROTATE_CW,
+  INPUT_ROTATE_CCW,
+  INPUT_PRESS,
+  INPUT_LONG_PRESS,
+};
+
+// Bit for an event type in the mask returned by `dispatch()`
+#define INPUT_MASK(type) (1 << (type))
+
+typedef struct InputEvent {
+  uint8_t type;
+  // micros() when the interrupt saw the input
+  unsigned long time;
+} input_event;
+
+typedef void (LED_Bars::*control_func)();
+
+typedef struct InputBinding {
+  uint8_t type;
+  control_func action;
+} input_binding;
+
+class LED_Input {
+
+private:
+  volatile input_event queue[LED_INPUT_QUEUE];
+  volatile uint8_t head = 0;
+  volatile uint8_t tail = 0;
+
+  uint8_t pins[3];
+#ifdef __AVR__
+  volatile uint8_t* pin_ports[3];
+  uint8_t pin_masks[3];
+#endif
+
+  uint8_t quad_state = 0;
+  int8_t quad_count = 0;
+  bool button_down = false;
+  unsigned long button_time = 0;
+
+  const input_binding* bindings = NULL;
+  uint8_t n_bindings = 0;
+
+  // Events lost because the queue was full, counted in the interrupt
+  volatile uint16_t dropped = 0;
+
+  bool read_pin(uint8_t index);
+  void push(uint8_t type);
+
+public:
+  // Time from an input to its binding being applied, in us
+  unsigned long last_latency = 0;
+  unsigned long max_latency = 0;
+
+  void begin(uint8_t pin_a, uint8_t pin_b, uint8_t pin_button);
+  void set_bindings(const input_binding* table, uint8_t count);
+  bool next(input_event* event);
+  uint8_t dispatch(LED_Bars& bars);
+  void reset_latency();
+  uint16_t get_dropped();
+  bool idle();
+
+  // Called from the pin change interrupts
+  void pins_changed();
+};
+
+// Decode the pins of the input that was started last, for pin change handlers
+void led_input_changed();
+
+#ifdef __AVR__
+// True once the sketch handles pin change interrupts, see `LED_INPUT_ISR()`
+extern bool led_input_interrupts;
+
+// Every pin change group is routed to the same handler so any pins can be used
+#if defined(PCINT1_vect)
+#define LED_INPUT_ISR_PCINT1 ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect));
+#else
+#define LED_INPUT_ISR_PCINT1
+#endif
+#if defined(PCINT2_vect)
+#define LED_INPUT_ISR_PCINT2 ISR(PCINT2_vect, ISR_ALIASOF(PCINT0_vect));
+#else
+#define LED_INPUT_ISR_PCINT2
+#endif
+
+#define LED_INPUT_ISR() \
+  bool led_input_interrupts = true; \
+  ISR(PCINT0_vect) { \
+    led_input_changed(); \
+  } \
+  LED_INPUT_ISR_PCINT1 \
+  LED_INPUT_ISR_PCINT2
+#else
+// Other boards attach their interrupts per pin and don't need anything from the sketch
+#define LED_INPUT_ISR()
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+#include "Arduino.h"
+#include "led_noise.h"
+#include "led_bars.h"
+
+// Ken Perlin's permutation of 0-255, wrapping 8 bit sums index it without a second copy
+static const uint8_t permutation[256] PROGMEM = {
+  151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225,
+  140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
+  247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32,
+  57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+  74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122,
+  60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54,
+  65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169,
+  200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
+  52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212,
+  207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213,
+  119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9,
+  129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
+  218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241,
+  81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157,
+  184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93,
+  222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180,
+};
+
+static inline uint8_t perm(uint8_t index) {
+  return pgm_read_byte(&permutation[index]);
+}
+
+// Smoothstep of a position within a cell, 3t^2 - 2t^3 with t out of 256
+uint8_t ease8(uint8_t t) {
+  uint16_t t2 = ((uint16_t)t * t) >> 8;
+  return (t2 * (768 - 2 * (uint16_t)t)) >> 8;
+}
+
+/*
+Value noise at a point in 3D.
+
+@param x, y, z Coordinates in 8.8 fixed point
+@return 0 to 255, mostly in the middle of the range and changing smoothly
+*/
+uint8_t noise8(uint16_t x, uint16_t y, uint16_t z) {
+  uint8_t xi = x >> 8;
+  uint8_t yi = y >> 8;
+  uint8_t zi = z >> 8;
+  uint8_t fx = ease8(x);
+  uint8_t fy = ease8(y);
+  uint8_t fz = ease8(z);
+
+  // Hash the corners of the cell the way Perlin noise does
+  uint8_t a = perm(xi) + yi;
+  uint8_t b = perm(xi + 1) + yi;
+  uint8_t aa = perm(a) + zi;
+  uint8_t ab = perm(a + 1) + zi;
+  uint8_t ba = perm(b) + zi;
+  uint8_t bb = perm(b + 1) + zi;
+
+  uint8_t near = lerp8(
+    lerp8(perm(aa), perm(ba), fx),
+    lerp8(perm(ab), perm(bb), fx),
+    fy
+  );
+  uint8_t far = lerp8(
+    lerp8(perm(aa + 1), perm(ba + 1), fx),
+    lerp8(perm(ab + 1), perm(bb + 1), fx),
+    fy
+  );
+  return lerp8(near, far, fz);
+}
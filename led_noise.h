@@ -0,0 +1,23 @@
+/*
+Fixed point value noise for smooth, organic motion.
+
+Coordinates are 8.8 fixed point, whole lattice cells in the high byte and the position
+within a cell in the low byte. Every lattice point gets a pseudo random value from Ken
+Perlin's permutation table in flash, and the values of the 8 corners around a point are
+blended with a smoothstep so the field has no visible grid. Time is usually the third axis.
+*/
+
+#ifndef led_noise_h
+#define led_noise_h
+
+#include "Arduino.h"
+
+// Leds between the points noise is evaluated at along a segment, the leds between are interpolated
+#ifndef LED_NOISE_STEP
+#define LED_NOISE_STEP 4
+#endif
+
+uint8_t ease8(uint8_t t);
+uint8_t noise8(uint16_t x, uint16_t y, uint16_t z);
+
+#endif
@@ -0,0 +1,120 @@
+#include "Arduino.h"
+#include "led_profile.h"
+
+void LED_Profile::begin_frame() {
+  for (uint8_t i = 0; i < PROFILE_STAGES; i++) {
+    stage_time[i] = 0;
+    stage_calls[i] = 0;
+    stage_samples[i] = 0;
+  }
+  blocked_time = 0;
+  frame_start = micros();
+}
+
+/*
+Close the current frame, estimating sampled stages from their call counts.
+
+@param pattern_index Pattern that rendered the frame
+*/
+void LED_Profile::end_frame(uint8_t pattern_index) {
+  uint32_t total = min(micros() - frame_start + blocked_time, 0xFFFFUL);
+  profile_frame& frame = frames[frame_head];
+  frame.pattern_index = pattern_index;
+  frame.total = total;
+  for (uint8_t i = 0; i < PROFILE_STAGES; i++) {
+    // Stages timed on every call never go through `sample()` and have no call count
+    uint32_t estimate = stage_time[i];
+    if (stage_calls[i] > stage_samples[i]) {
+      estimate = stage_time[i] * stage_calls[i] / stage_samples[i];
+    }
+    frame.stages[i] = min(estimate, 0xFFFFUL);
+  }
+  frame_head = (frame_head + 1) % LED_PROFILE_FRAMES;
+
+  if (pattern_index >= LED_PROFILE_PATTERNS) {
+    return;
+  }
+  profile_pattern& stats = patterns[pattern_index];
+  // Halve both counts before the frame count overflows, the average stays the same
+  if (stats.frames == 0xFFFF) {
+    stats.frames >>= 1;
+    stats.total >>= 1;
+  }
+  stats.frames++;
+  stats.total += total;
+  stats.worst = max(stats.worst, (uint16_t)total);
+}
+
+// Count a call to a sampled stage, returns true if this call should be timed
+bool LED_Profile::sample(uint8_t stage) {
+  return (stage_calls[stage]++ & (LED_PROFILE_SAMPLE - 1)) == 0;
+}
+
+void LED_Profile::add(uint8_t stage, unsigned long time) {
+  stage_time[stage] += time;
+  stage_samples[stage]++;
+}
+
+/*
+Replace the timing of a stage that ran with interrupts off by how long it is known to take.
+
+`micros()` can't see more than one Timer0 overflow while interrupts are off, the time it
+missed is added back to the frame total too.
+*/
+void LED_Profile::set_blocked(uint8_t stage, unsigned long time) {
+  if (time > stage_time[stage]) {
+    blocked_time += time - stage_time[stage];
+  }
+  stage_time[stage] = time;
+}
+
+// Most recently finished frame
+const profile_frame& LED_Profile::last_frame() {
+  return frames[(frame_head + LED_PROFILE_FRAMES - 1) % LED_PROFILE_FRAMES];
+}
+
+void LED_Profile::reset() {
+  memset(frames, 0, sizeof(frames));
+  memset(patterns, 0, sizeof(patterns));
+  frame_head = 0;
+  begin_frame();
+}
+
+// Print the pattern aggregates then the recent frames, oldest first, all times in us
+void LED_Profile::dump(Print& out) {
+  out.println("pattern frames average worst");
+  for (uint8_t i = 0; i < LED_PROFILE_PATTERNS; i++) {
+    profile_pattern& stats = patterns[i];
+    if (stats.frames == 0) {
+      continue;
+    }
+    out.print(i);
+    out.print(" ");
+    out.print(stats.frames);
+    out.print(" ");
+    out.print(stats.total / stats.frames);
+    out.print(" ");
+    out.println(stats.worst);
+  }
+
+#ifdef __AVR__
+  out.print("show counted as ");
+  out.print(LED_PROFILE_SHOW_US);
+  out.println("us a led, micros() stops while it sends");
+#endif
+  out.println("pattern total pattern color set_led show");
+  for (uint8_t i = 0; i < LED_PROFILE_FRAMES; i++) {
+    profile_frame& frame = frames[(frame_head + i) % LED_PROFILE_FRAMES];
+    if (frame.total == 0) {
+      continue;
+    }
+    out.print(frame.pattern_index);
+    out.print(" ");
+    out.print(frame.total);
+    for (uint8_t j = 0; j < PROFILE_STAGES; j++) {
+      out.print(" ");
+      out.print(frame.stages[j]);
+    }
+    out.println();
+  }
+}
@@ -0,0 +1,125 @@
+/*
+Frame timing for finding where render time goes, only compiled in with `-DLED_PROFILE`.
+
+Each frame records the time spent in the pattern, in `color()`, in `set_led_color()` and in
+`strip.show()`. The pattern time includes the color and led calls it makes. Color and led
+calls happen hundreds of times a frame and timing each would cost more than the calls, so
+only one call in `LED_PROFILE_SAMPLE` is timed and the total is estimated from the call count.
+
+The last few frames are kept in a ring buffer and every pattern keeps a running total and
+its worst frame, `dump()` prints both.
+
+On AVR `strip.show()` keeps interrupts off while it sends, so Timer0 overflows are lost and
+`micros()` across it comes out a few ms short for a full strip. The show stage is recorded
+as `LED_PROFILE_SHOW_US` per led instead, the time sending takes at 800kHz, and the frame
+total is corrected by the same amount.
+*/
+
+#ifndef led_profile_h
+#define led_profile_h
+
+#include "Arduino.h"
+
+// Frames kept in the ring buffer
+#ifndef LED_PROFILE_FRAMES
+#define LED_PROFILE_FRAMES 8
+#endif
+
+// Patterns with aggregates, 8 bytes each, at least the size of the pattern table in led_bars.h
+#ifndef LED_PROFILE_PATTERNS
+#define LED_PROFILE_PATTERNS 26
+#endif
+
+// One in this many color and led calls is timed, must be a power of two
+#ifndef LED_PROFILE_SAMPLE
+#define LED_PROFILE_SAMPLE 32
+#endif
+
+// Time to send one led, 24 bits at 1.25us each
+#ifndef LED_PROFILE_SHOW_US
+#define LED_PROFILE_SHOW_US 30
+#endif
+
+enum profile_stage {
+  PROFILE_PATTERN,
+  PROFILE_COLOR,
+  PROFILE_SET_LED,
+  PROFILE_SHOW,
+  PROFILE_STAGES,
+};
+
+typedef struct ProfileFrame {
+  uint8_t pattern_index;
+  // Whole call to `render()` and each stage, in us
+  uint16_t total;
+  uint16_t stages[PROFILE_STAGES];
+} profile_frame;
+
+typedef struct ProfilePattern {
+  uint16_t frames;
+  uint32_t total;
+  uint16_t worst;
+} profile_pattern;
+
+class LED_Profile {
+
+private:
+  unsigned long frame_start = 0;
+  uint32_t stage_time[PROFILE_STAGES];
+  uint16_t stage_calls[PROFILE_STAGES];
+  uint16_t stage_samples[PROFILE_STAGES];
+  // Time `micros()` missed this frame while interrupts were off
+  unsigned long blocked_time = 0;
+
+public:
+  profile_frame frames[LED_PROFILE_FRAMES];
+  // Index the next frame is written to
+  uint8_t frame_head = 0;
+  profile_pattern patterns[LED_PROFILE_PATTERNS];
+
+  LED_Profile() {
+    reset();
+  };
+
+  void begin_frame();
+  void end_frame(uint8_t pattern_index);
+  bool sample(uint8_t stage);
+  void add(uint8_t stage, unsigned long time);
+  void set_blocked(uint8_t stage, unsigned long time);
+  const profile_frame& last_frame();
+  void reset();
+  void dump(Print& out);
+};
+
+// Times the rest of the enclosing block, sampled stages only time some of the calls
+class ProfileScope {
+
+private:
+  LED_Profile& profile;
+  uint8_t stage;
+  unsigned long start;
+  bool timing;
+
+public:
+  ProfileScope(LED_Profile& target, uint8_t stage_index, bool sampled) : profile(target) {
+    stage = stage_index;
+    timing = sampled == false || profile.sample(stage);
+    start = timing ? micros() : 0;
+  };
+
+  ~ProfileScope() {
+    if (timing) {
+      profile.add(stage, micros() - start);
+    }
+  };
+};
+
+#ifdef LED_PROFILE
+#define PROFILE_SCOPE(stage) ProfileScope profile_scope(profile, stage, false)
+#define PROFILE_SAMPLE(stage) ProfileScope profile_scope(profile, stage, true)
+#else
+#define PROFILE_SCOPE(stage)
+#define PROFILE_SAMPLE(stage)
+#endif
+
+#endif
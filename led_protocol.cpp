@@ -0,0 +1,135 @@
+#include "Arduino.h"
+#include "led_protocol.h"
+#include "led_settings.h"
+
+// Bytes in a packet around the sequence and commands, sync, length and crc
+#define PROTOCOL_FRAMING 3
+
+// Full length of the packet at the start of the buffer, 0 while the length is unknown
+uint8_t LED_Protocol::packet_length() {
+  if (rx_len < 2) {
+    return 0;
+  }
+  return rx[1] + PROTOCOL_FRAMING;
+}
+
+/*
+Read and handle whatever the stream has available, call once per frame.
+
+Never reads more than `LED_PROTOCOL_BUDGET` bytes and only reads up to the end of the
+current packet, so a complete packet always starts at the beginning of the buffer and
+nothing ever has to be moved. Bytes that can't start a packet are dropped to resync.
+
+@param bars Target of the commands
+*/
+void LED_Protocol::poll(LED_Bars& bars) {
+  for (uint8_t budget = LED_PROTOCOL_BUDGET; budget > 0; budget--) {
+    if (stream->available() <= 0) {
+      return;
+    }
+    uint8_t value = stream->read();
+    if (rx_len == 0 && value != LED_PROTOCOL_SYNC) {
+      continue;
+    }
+    rx[rx_len++] = value;
+
+    if (rx_len == 2 && (value == 0 || packet_length() > LED_PROTOCOL_BUFFER)) {
+      errors++;
+      rx_len = 0;
+      continue;
+    }
+    if (rx_len > 2 && rx_len == packet_length()) {
+      if (led_crc8(rx + 1, rx_len - 2) == rx[rx_len - 1]) {
+        handle_packet(bars);
+      } else {
+        errors++;
+      }
+      rx_len = 0;
+    }
+  }
+}
+
+// Run the batch of commands in the packet at the start of the buffer, straight from the buffer
+void LED_Protocol::handle_packet(LED_Bars& bars) {
+  uint8_t* command = rx + 3;
+  uint8_t* end = rx + rx_len - 1;
+  uint8_t status = STATUS_OK;
+  uint8_t applied = 0;
+  bool stats = false;
+
+  packets++;
+  while (command < end) {
+    uint8_t op = *command++;
+    if (op == CMD_QUERY_STATS) {
+      stats = true;
+      applied++;
+      continue;
+    }
+    if (op == CMD_SAVE) {
+      bars.save_values();
+      applied++;
+      continue;
+    }
+    if (op < CMD_SET_PATTERN || op > CMD_SET_BRIGHTNESS || command >= end) {
+      status = STATUS_BAD_COMMAND;
+      break;
+    }
+
+    uint8_t value = *command++;
+    bool valid = true;
+    switch (op) {
+      case CMD_SET_PATTERN:
+        valid = bars.set_pattern_index(value);
+        break;
+      case CMD_SET_COLOR:
+        valid = bars.set_color_index(value);
+        break;
+      case CMD_SET_HUE:
+        bars.set_color_hue(value);
+        break;
+      case CMD_SET_BRIGHTNESS:
+        bars.set_brightness(value);
+        break;
+    }
+    if (valid == true) {
+      applied++;
+    } else {
+      status = STATUS_BAD_VALUE;
+    }
+  }
+  acknowledge(bars, status, applied, stats);
+}
+
+/*
+Answer the packet at the start of the buffer.
+
+Stats are the pattern, color, hue, brightness, pattern and color counts, the frame
+count as 32 bits and the packet error count as 16 bits, little endian.
+*/
+void LED_Protocol::acknowledge(LED_Bars& bars, uint8_t status, uint8_t applied, bool stats) {
+  uint8_t tx[LED_PROTOCOL_BUFFER];
+  uint8_t len = 0;
+  tx[len++] = LED_PROTOCOL_SYNC;
+  tx[len++] = 0;
+  tx[len++] = rx[2];
+  tx[len++] = status;
+  tx[len++] = applied;
+  if (stats == true) {
+    unsigned long frames = bars.get_frame_count();
+    tx[len++] = bars.get_pattern_index();
+    tx[len++] = bars.get_color_index();
+    tx[len++] = bars.get_color_hue();
+    tx[len++] = bars.get_brightness();
+    tx[len++] = bars.get_num_patterns();
+    tx[len++] = bars.get_num_colors();
+    for (uint8_t i = 0; i < 4; i++) {
+      tx[len++] = frames >> (8 * i);
+    }
+    tx[len++] = errors;
+    tx[len++] = errors >> 8;
+  }
+  tx[1] = len - 2;
+  tx[len] = led_crc8(tx + 1, len - 1);
+  len++;
+  stream->write(tx, len);
+}
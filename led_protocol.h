@@ -0,0 +1,75 @@
+/*
+Compact binary control protocol for `LED_Bars` over any `Stream`.
+
+A packet carries a batch of commands so several settings can change in a single frame:
+
+  0xA5 | length | sequence | commands... | crc
+
+`length` counts the sequence and command bytes and `crc` is the CRC-8 of everything from
+`length` on. Every valid packet is answered with an acknowledgement in the same framing:
+
+  0xA5 | length | sequence | status | applied | stats... | crc
+
+where `applied` is the number of commands that took effect and the stats are only
+included when the batch contained a query. Packets are parsed in place from a fixed
+receive buffer and `poll()` reads a bounded number of bytes per call so remote control
+never costs more than a small, fixed slice of a frame.
+*/
+
+#ifndef led_protocol_h
+#define led_protocol_h
+
+#include "Arduino.h"
+#include "led_bars.h"
+
+#define LED_PROTOCOL_SYNC 0xA5
+
+// Receive buffer size, the largest packet including framing
+#ifndef LED_PROTOCOL_BUFFER
+#define LED_PROTOCOL_BUFFER 32
+#endif
+
+// Most bytes read from the stream in one call to `poll()`
+#ifndef LED_PROTOCOL_BUDGET
+#define LED_PROTOCOL_BUDGET 32
+#endif
+
+enum protocol_command {
+  CMD_SET_PATTERN = 0x01,  // pattern index
+  CMD_SET_COLOR = 0x02,  // color index
+  CMD_SET_HUE = 0x03,  // hue
+  CMD_SET_BRIGHTNESS = 0x04,  // brightness
+  CMD_QUERY_STATS = 0x05,
+  CMD_SAVE = 0x06,
+};
+
+enum protocol_status {
+  STATUS_OK = 0x00,
+  STATUS_BAD_COMMAND = 0x01,  // unknown or truncated command, the rest of the batch was skipped
+  STATUS_BAD_VALUE = 0x02,  // a value was out of range and that command was skipped
+};
+
+class LED_Protocol {
+
+private:
+  Stream* stream;
+  uint8_t rx[LED_PROTOCOL_BUFFER];
+  uint8_t rx_len = 0;
+
+  uint8_t packet_length();
+  void handle_packet(LED_Bars& bars);
+  void acknowledge(LED_Bars& bars, uint8_t status, uint8_t applied, bool stats);
+
+public:
+  // Valid packets handled and packets dropped for a bad length or crc
+  uint16_t packets = 0;
+  uint16_t errors = 0;
+
+  LED_Protocol(Stream& source) {
+    stream = &source;
+  };
+
+  void poll(LED_Bars& bars);
+};
+
+#endif
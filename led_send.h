@@ -0,0 +1,48 @@
+/*
+Bit banged output for frames the NeoPixel library can't send from its own buffer, shared by
+indexed and calibrated frames. Only included by the library's own sources.
+*/
+
+#ifndef led_send_h
+#define led_send_h
+
+#include "Arduino.h"
+
+// The timing below is counted in cycles, other clocks fall back to the NeoPixel output
+#if defined(__AVR__) && F_CPU == 16000000L
+#define LED_SEND_AVR
+
+/*
+Send a byte most significant bit first at 800kHz, cycle counted for 16MHz.
+
+Zero bits are high for 6 cycles (375ns) of 21, one bits for 13 (812ns) of 20.
+*/
+static inline void led_send_byte(volatile uint8_t* port, uint8_t hi, uint8_t lo, uint8_t value) {
+  uint8_t bits = 8;
+  asm volatile(
+    "1:"                           "\n\t"
+    "st %a[port], %[hi]"           "\n\t"  // 2, line goes high
+    "nop"                          "\n\t"  // 3
+    "nop"                          "\n\t"
+    "nop"                          "\n\t"
+    "sbrs %[value], 7"             "\n\t"  // 1, 2 skipping when the bit is set
+    "st %a[port], %[lo]"           "\n\t"  // 2, zero bits go low
+    "lsl %[value]"                 "\n\t"  // 1
+    "nop"                          "\n\t"  // 5
+    "nop"                          "\n\t"
+    "nop"                          "\n\t"
+    "nop"                          "\n\t"
+    "nop"                          "\n\t"
+    "st %a[port], %[lo]"           "\n\t"  // 2, one bits go low
+    "nop"                          "\n\t"  // 2
+    "nop"                          "\n\t"
+    "dec %[bits]"                  "\n\t"  // 1
+    "brne 1b"                      "\n\t"  // 2
+    : [value] "+r" (value), [bits] "+r" (bits)
+    : [port] "e" (port), [hi] "r" (hi), [lo] "r" (lo)
+  );
+}
+
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+#include "Arduino.h"
+#include "led_settings.h"
+#include <EEPROM.h>
+
+#ifdef __AVR__
+#include <avr/eeprom.h>
+#endif
+
+
+// CRC-8 with the 0x07 polynomial, small and plenty for a few bytes
+uint8_t led_crc8(const uint8_t* data, uint8_t length) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+int LED_Settings::slot_addr(uint8_t index) {
+  return LED_SETTINGS_ADDR + index * sizeof(settings_record);
+}
+
+// Read a slot and check it holds a complete record of the current version
+bool LED_Settings::read_slot(uint8_t index, settings_record* record) {
+  uint8_t* bytes = (uint8_t*)record;
+  int addr = slot_addr(index);
+  for (uint8_t i = 0; i < sizeof(settings_record); i++) {
+    bytes[i] = EEPROM.read(addr + i);
+  }
+  return record->version == LED_SETTINGS_VERSION
+    && record->crc == led_crc8(bytes, sizeof(settings_record) - 1);
+}
+
+// Can a byte be written without blocking on a previous write
+bool LED_Settings::eeprom_ready() {
+#ifdef __AVR__
+  return eeprom_is_ready();
+#else
+  return true;
+#endif
+}
+
+/*
+Find the newest valid record in the ring.
+
+Sequence numbers are compared by their signed difference so they can wrap around,
+which works as long as the ring has fewer than 128 slots.
+
+@param record Filled with the newest record when one is found
+
+@return Whether a valid record was found
+*/
+bool LED_Settings::load(settings_record* record) {
+  settings_record candidate;
+  slot = -1;
+  for (uint8_t i = 0; i < LED_SETTINGS_SLOTS; i++) {
+    if (read_slot(i, &candidate) == false) {
+      continue;
+    }
+    if (slot == -1 || (int8_t)(candidate.sequence - sequence) > 0) {
+      slot = i;
+      sequence = candidate.sequence;
+      latest = candidate;
+    }
+  }
+  *record = latest;
+  return slot != -1;
+}
+
+/*
+Queue a record to be written.
+
+The write starts once the settings have been left alone for `LED_SETTINGS_DELAY` ms,
+so scrolling through patterns only writes the one that is kept. Saving the same values
+as the newest record does nothing.
+*/
+void LED_Settings::save(settings_record record) {
+  if (record.pattern_index == latest.pattern_index
+      && record.color_index == latest.color_index
+      && record.brightness == latest.brightness
+      && record.color_hue == latest.color_hue) {
+    return;
+  }
+  latest = record;
+  dirty = true;
+  dirty_time = millis();
+}
+
+/*
+Make progress on any pending write, called once per frame.
+
+Writes at most a single byte and only when the EEPROM has finished the previous one,
+so this never stalls a frame. The crc is the last byte written which means a record
+only becomes valid once it is complete.
+*/
+void LED_Settings::update() {
+  if (write_pos < 0) {
+    if (dirty == false || millis() - dirty_time < LED_SETTINGS_DELAY) {
+      return;
+    }
+    dirty = false;
+    slot = (slot + 1) % LED_SETTINGS_SLOTS;
+    sequence++;
+    writing = latest;
+    writing.version = LED_SETTINGS_VERSION;
+    writing.sequence = sequence;
+    writing.crc = led_crc8((uint8_t*)&writing, sizeof(settings_record) - 1);
+    write_pos = 0;
+  }
+
+  if (eeprom_ready() == false) {
+    return;
+  }
+  EEPROM.update(slot_addr(slot) + write_pos, ((uint8_t*)&writing)[write_pos]);
+  write_pos++;
+  if (write_pos >= (int8_t)sizeof(settings_record)) {
+    write_pos = -1;
+  }
+}
+
+// Write anything pending right away, blocking until it is done
+void LED_Settings::flush() {
+  if (dirty == true) {
+    dirty_time = millis() - LED_SETTINGS_DELAY;
+  }
+  while (busy() == true) {
+    update();
+  }
+}
+
+bool LED_Settings::busy() {
+  return dirty == true || write_pos >= 0;
+}
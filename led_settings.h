@@ -0,0 +1,72 @@
+/*
+Wear leveled storage for the user settings of `LED_Bars` in EEPROM.
+
+Records are written to a ring of slots instead of fixed addresses so every write lands on
+different cells. Each record carries a version, a sequence number and a crc so a torn or
+stale write is ignored in favor of the previous record. Saving is deferred and the write
+itself is spread out a byte at a time by `update()`, which never waits on the EEPROM.
+*/
+
+#ifndef led_settings_h
+#define led_settings_h
+
+#include "Arduino.h"
+
+// First EEPROM address used for settings
+#ifndef LED_SETTINGS_ADDR
+#define LED_SETTINGS_ADDR 0
+#endif
+
+// Number of slots in the ring, multiplies the lifetime of the EEPROM cells
+#ifndef LED_SETTINGS_SLOTS
+#define LED_SETTINGS_SLOTS 16
+#endif
+
+// How long settings need to stay unchanged before they are written, in ms
+#ifndef LED_SETTINGS_DELAY
+#define LED_SETTINGS_DELAY 3000
+#endif
+
+// Bump when the record layout changes so old records are ignored
+#define LED_SETTINGS_VERSION 1
+
+typedef struct SettingsRecord {
+  uint8_t version;
+  uint8_t sequence;
+  uint8_t pattern_index;
+  uint8_t color_index;
+  uint8_t brightness;
+  uint8_t color_hue;
+  uint8_t crc;
+} settings_record;
+
+uint8_t led_crc8(const uint8_t* data, uint8_t length);
+
+class LED_Settings {
+
+private:
+  // Slot and sequence of the newest record in EEPROM, -1 if there is none
+  int8_t slot = -1;
+  uint8_t sequence = 0;
+
+  // Values most recently saved or loaded and the record currently being written
+  settings_record latest = {};
+  settings_record writing;
+  bool dirty = false;
+  unsigned long dirty_time = 0;
+  // Next byte of `writing` to write, -1 when no write is in progress
+  int8_t write_pos = -1;
+
+  int slot_addr(uint8_t index);
+  bool read_slot(uint8_t index, settings_record* record);
+  bool eeprom_ready();
+
+public:
+  bool load(settings_record* record);
+  void save(settings_record record);
+  void update();
+  void flush();
+  bool busy();
+};
+
+#endif
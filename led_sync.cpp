@@ -0,0 +1,163 @@
+#include "Arduino.h"
+#include "led_sync.h"
+#include "led_settings.h"
+
+// The animation clock is a plain function, only one follower can drive it
+static LED_Sync* active_sync = NULL;
+
+static unsigned long sync_clock() {
+  return active_sync->now();
+}
+
+static void write32(uint8_t* buffer, uint32_t value) {
+  for (uint8_t i = 0; i < 4; i++) {
+    buffer[i] = value >> (8 * i);
+  }
+}
+
+static uint32_t read32(const uint8_t* buffer) {
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    value |= (uint32_t)buffer[i] << (8 * i);
+  }
+  return value;
+}
+
+/*
+Broadcast the leader's state, call once per frame after any controls are applied.
+
+A message goes out straight away when the pattern, color, hue or brightness changes and
+every `LED_SYNC_INTERVAL` otherwise. Each new pattern gets a new seed so random patterns
+start from the same state everywhere. The pattern has already been entered with the old
+seed by then, so it's restarted from the new one the way followers start it.
+*/
+void LED_Sync::lead(LED_Bars& bars) {
+  uint8_t pattern = bars.get_pattern_index();
+  if (pattern != sent_pattern) {
+    seed_value = seed_value * 1103515245UL + 12345;
+    bars.seed(seed_value);
+    bars.restart_pattern();
+  }
+  bool changed = pattern != sent_pattern || bars.get_color_index() != sent_color
+    || bars.get_color_hue() != sent_hue || bars.get_brightness() != sent_brightness;
+  if (changed || millis() - last_send >= LED_SYNC_INTERVAL) {
+    send(bars);
+  }
+}
+
+void LED_Sync::send(LED_Bars& bars) {
+  uint8_t tx[LED_SYNC_PAYLOAD + 3];
+  sent_pattern = bars.get_pattern_index();
+  sent_color = bars.get_color_index();
+  sent_hue = bars.get_color_hue();
+  sent_brightness = bars.get_brightness();
+
+  tx[0] = LED_SYNC_START;
+  tx[1] = LED_SYNC_PAYLOAD;
+  write32(tx + 2, led_time());
+  tx[6] = sent_pattern;
+  tx[7] = sent_color;
+  tx[8] = sent_hue;
+  tx[9] = sent_brightness;
+  write32(tx + 10, seed_value);
+  tx[14] = led_crc8(tx + 1, LED_SYNC_PAYLOAD + 1);
+  stream->write(tx, sizeof(tx));
+  last_send = millis();
+}
+
+/*
+Read the leader's messages and keep the clock in step, call as often as possible.
+
+The first call switches the library's animation clock over to this follower's clock.
+Calling more often than once a frame, such as between frames, shortens the delay before
+a message is seen and keeps the clock closer.
+*/
+void LED_Sync::follow(LED_Bars& bars) {
+  if (active_sync != this) {
+    active_sync = this;
+    set_led_clock(sync_clock);
+  }
+
+  int available = stream->available();
+  while (available-- > 0) {
+    uint8_t value = stream->read();
+    if (rx_len == 0 && value != LED_SYNC_START) {
+      continue;
+    }
+    rx[rx_len++] = value;
+    if (rx_len == 2 && value != LED_SYNC_PAYLOAD) {
+      errors++;
+      rx_len = 0;
+      continue;
+    }
+    if (rx_len == sizeof(rx)) {
+      if (led_crc8(rx + 1, LED_SYNC_PAYLOAD + 1) == rx[rx_len - 1]) {
+        handle_packet(bars);
+      } else {
+        errors++;
+      }
+      rx_len = 0;
+    }
+  }
+  last_follow = millis();
+  slew();
+}
+
+void LED_Sync::handle_packet(LED_Bars& bars) {
+  uint32_t leader_time = read32(rx + 2) + LED_SYNC_LATENCY;
+  // Arrived after the last call at the earliest and now at the latest
+  long low = (long)(leader_time - millis());
+  long high = (long)(leader_time - last_follow);
+  last_error = (long)(leader_time - now());
+  packets++;
+
+  if (locked == false || abs(low - offset) > LED_SYNC_JUMP) {
+    offset = low;
+    offset_low = low;
+    offset_high = high;
+    locked = true;
+  } else {
+    offset_low = max(low, offset_low - LED_SYNC_DECAY);
+    offset_high = min(high, offset_high + LED_SYNC_DECAY);
+    // Bounds that no longer overlap mean the drift estimate was off, start again from this message
+    if (offset_low > offset_high) {
+      offset_low = low;
+      offset_high = high;
+    }
+  }
+
+  // Seed before the pattern enters, boards and snakes are set up from the generators
+  uint32_t seed = read32(rx + 10);
+  bool reseeded = seed != seed_value;
+  if (reseeded == true) {
+    seed_value = seed;
+    bars.seed(seed);
+  }
+  if (rx[6] != bars.get_pattern_index()) {
+    bars.set_pattern_index(rx[6]);
+  } else if (reseeded == true) {
+    bars.restart_pattern();
+  }
+  if (rx[7] != bars.get_color_index()) {
+    bars.set_color_index(rx[7]);
+  }
+  bars.set_color_hue(rx[8]);
+  bars.set_brightness(rx[9]);
+}
+
+// Move the offset toward its target, at most 1/16th of the time passed so the clock never steps back
+void LED_Sync::slew() {
+  unsigned long time = millis();
+  long step = (time - last_slew) >> 4;
+  if (step == 0) {
+    return;
+  }
+  last_slew = time;
+  long target = offset_low + (offset_high - offset_low) / 2;
+  offset += constrain(target - offset, -step, step);
+}
+
+// Leader time as seen by this follower, in ms
+unsigned long LED_Sync::now() {
+  return millis() + offset;
+}
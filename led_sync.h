@@ -0,0 +1,92 @@
+/*
+Keeps several controllers, each driving part of a larger wall, showing the same animation.
+
+A leader broadcasts its animation clock and state over a serial link wired to every follower's
+receive pin:
+
+  0x5A | length | time (4) | pattern | color | hue | brightness | seed (4) | crc
+
+little endian, with `crc` the CRC-8 of everything from `length` on. Followers apply the
+state and run their animations from a synced clock, see `set_led_clock()`.
+
+A message is only seen when `follow()` gets to it, so all a follower knows is that it arrived
+between the last call and this one. That bounds the clock offset from both sides, the bounds
+from recent messages are intersected and widened a little each message so a follower crystal
+running fast or slow is still tracked. The clock then slews toward the middle of the bounds
+without ever stepping back, only a follower that is far out, such as at power on, jumps.
+*/
+
+#ifndef led_sync_h
+#define led_sync_h
+
+#include "Arduino.h"
+#include "led_bars.h"
+
+#define LED_SYNC_START 0x5A
+#define LED_SYNC_PAYLOAD 12
+
+// Time between leader broadcasts when nothing changes, in ms
+#ifndef LED_SYNC_INTERVAL
+#define LED_SYNC_INTERVAL 250
+#endif
+
+// Followers further out than this jump straight to the leader's time, in ms
+#ifndef LED_SYNC_JUMP
+#define LED_SYNC_JUMP 500
+#endif
+
+// Time a message takes on the wire, 15 bytes at 115200 baud, in ms
+#ifndef LED_SYNC_LATENCY
+#define LED_SYNC_LATENCY 1
+#endif
+
+// How far the offset bounds widen per message to allow for crystal drift, in ms
+#ifndef LED_SYNC_DECAY
+#define LED_SYNC_DECAY 2
+#endif
+
+class LED_Sync {
+
+private:
+  Stream* stream;
+  uint8_t rx[LED_SYNC_PAYLOAD + 3];
+  uint8_t rx_len = 0;
+
+  // Clock offset the follower runs at and the bounds on the leader's actual offset
+  long offset = 0;
+  long offset_low = 0;
+  long offset_high = 0;
+  bool locked = false;
+  unsigned long last_slew = 0;
+  unsigned long last_follow = 0;
+
+  // Leader state already broadcast
+  uint8_t sent_pattern = 0xFF;
+  uint8_t sent_color = 0xFF;
+  uint8_t sent_hue = 0;
+  uint8_t sent_brightness = 0;
+  unsigned long last_send = 0;
+
+  uint32_t seed_value = 1;
+
+  void send(LED_Bars& bars);
+  void handle_packet(LED_Bars& bars);
+  void slew();
+
+public:
+  // Valid messages received and messages dropped for a bad length or crc
+  uint16_t packets = 0;
+  uint16_t errors = 0;
+  // Leader time minus follower time when the last message was handled, in ms
+  long last_error = 0;
+
+  LED_Sync(Stream& link) {
+    stream = &link;
+  };
+
+  void lead(LED_Bars& bars);
+  void follow(LED_Bars& bars);
+  unsigned long now();
+};
+
+#endif
@@ -0,0 +1,400 @@
+#include "Arduino.h"
+#include "led_vm.h"
+#include "led_bars.h"
+#include "led_settings.h"
+#include <EEPROM.h>
+
+// First quarter of a sine wave with 256 steps per cycle, scaled to 127
+static const uint8_t quarter_sine[65] PROGMEM = {
+  0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+  49, 51, 54, 57, 60, 63, 65, 68, 71, 73, 76, 78, 81, 83, 85, 88,
+  90, 92, 94, 96, 98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+  117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+  127,
+};
+
+static uint8_t sin8(uint8_t phase) {
+  uint8_t index = phase & 63;
+  uint8_t value = pgm_read_byte(&quarter_sine[phase & 64 ? 64 - index : index]);
+  return phase & 128 ? 128 - value : 128 + value;
+}
+
+// Forget variables and particles, a new program starts from nothing
+void LED_VM::reset() {
+  for (uint8_t i = 0; i < LED_VM_VARS; i++) {
+    vars[i] = 0;
+  }
+  for (uint8_t i = 0; i < LED_VM_PARTICLES; i++) {
+    particles[i].segment = 0xFF;
+  }
+  last_move = led_time();
+}
+
+// Load a program from RAM, returns false if it's too large
+bool LED_VM::load(const uint8_t* program, uint8_t count) {
+  if (count > LED_VM_SIZE) {
+    return false;
+  }
+  memcpy(code, program, count);
+  length = count;
+  reset();
+  return true;
+}
+
+// Load a program stored in flash with PROGMEM
+bool LED_VM::load_P(const uint8_t* program, uint8_t count) {
+  if (count > LED_VM_SIZE) {
+    return false;
+  }
+  memcpy_P(code, program, count);
+  length = count;
+  reset();
+  return true;
+}
+
+// Load the program saved with `save_eeprom()`, nothing runs if it's missing or corrupt
+bool LED_VM::load_eeprom(int addr) {
+  length = 0;
+  uint8_t count = EEPROM.read(addr + 1);
+  if (EEPROM.read(addr) != LED_VM_START || count == 0 || count > LED_VM_SIZE) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    code[i] = EEPROM.read(addr + 2 + i);
+  }
+  if (led_crc8(code, count) != EEPROM.read(addr + 2 + count)) {
+    return false;
+  }
+  length = count;
+  reset();
+  return true;
+}
+
+/*
+Save the current program to EEPROM to load at the next power on.
+
+Unlike the settings this writes straight away, a byte takes about 3.3ms on AVR
+so only save programs on request rather than during a show.
+*/
+void LED_VM::save_eeprom(int addr) {
+  EEPROM.update(addr, LED_VM_START);
+  EEPROM.update(addr + 1, length);
+  for (uint8_t i = 0; i < length; i++) {
+    EEPROM.update(addr + 2 + i, code[i]);
+  }
+  EEPROM.update(addr + 2 + length, led_crc8(code, length));
+}
+
+/*
+Read a program upload from a stream, call once per frame.
+
+The program is received straight into the code buffer so nothing runs while an upload is
+in progress, and nothing afterwards if it fails its check.
+
+@return True when a complete program has just been loaded
+*/
+bool LED_VM::receive(Stream& source) {
+  while (source.available() > 0) {
+    uint8_t value = source.read();
+    if (rx_len == 0) {
+      rx_len = value == LED_VM_START ? 1 : 0;
+      continue;
+    }
+    if (rx_len == 1) {
+      if (value == 0 || value > LED_VM_SIZE) {
+        faults++;
+        rx_len = 0;
+        continue;
+      }
+      upload_length = value;
+      length = 0;
+      rx_len++;
+      continue;
+    }
+    if (rx_len - 2 < upload_length) {
+      code[rx_len - 2] = value;
+      rx_len++;
+      continue;
+    }
+    rx_len = 0;
+    if (led_crc8(code, upload_length) != value) {
+      faults++;
+      continue;
+    }
+    length = upload_length;
+    reset();
+    return true;
+  }
+  return false;
+}
+
+// Advance every particle by the time since the last move and draw it between leds
+void LED_VM::move_particles(LED_Bars& bars, uint8_t bright) {
+  unsigned long time = led_time();
+  // A program that hasn't moved its particles in a while picks up where it was
+  long elapsed = min(time - last_move, 100UL);
+  last_move = time;
+  long end = ((long)bars.led_per_segment - 1) << 8;
+
+  for (uint8_t i = 0; i < LED_VM_PARTICLES; i++) {
+    vm_particle& part = particles[i];
+    if (part.segment == 0xFF) {
+      continue;
+    }
+    long position = part.position + (part.velocity * elapsed) / 10;
+    if (position < 0 || position > end || part.segment >= bars.active_segments) {
+      part.segment = 0xFF;
+      continue;
+    }
+    part.position = position;
+    uint32_t color_value = bars.color(position >> 8, part.segment, 0);
+    bars.set_led_color_subpixel(part.segment, position, color_value, bright);
+  }
+}
+
+/*
+Run the program for one frame.
+
+Dispatch goes through a table of label addresses, each instruction jumps straight to the
+next one's handler without returning to a loop or a switch. Stack, variable and jump
+errors stop the frame and count as a fault.
+*/
+void LED_VM::run(LED_Bars& bars) {
+  static const void* const dispatch[OP_COUNT] = {
+    &&op_end, &&op_push8, &&op_push16, &&op_load, &&op_store, &&op_dup, &&op_drop, &&op_swap,
+    &&op_add, &&op_sub, &&op_mul, &&op_scale, &&op_div, &&op_mod, &&op_lt, &&op_gt,
+    &&op_time, &&op_segments, &&op_leds, &&op_sin, &&op_tri, &&op_rand, &&op_jmp, &&op_jz,
+    &&op_loop, &&op_pixel, &&op_subpixel, &&op_span, &&op_hue, &&op_palette, &&op_blend,
+    &&op_spawn, &&op_move,
+  };
+  int16_t stack[LED_VM_STACK];
+  uint8_t sp = 0;
+  uint8_t pc = 0;
+  uint16_t steps = 0;
+  bool palette = true;
+  uint32_t draw_color = 0;
+  int16_t a, b, c, d;
+  uint8_t op;
+
+#define FETCH() (pc < length ? code[pc++] : (uint8_t)OP_END)
+#define NEXT() do { \
+    if (++steps > LED_VM_BUDGET) { overruns++; goto done; } \
+    op = FETCH(); \
+    if (op >= OP_COUNT) goto fault; \
+    goto *dispatch[op]; \
+  } while (0)
+#define PUSH(value) do { if (sp >= LED_VM_STACK) goto fault; stack[sp++] = (value); } while (0)
+#define POP(value) do { if (sp == 0) goto fault; value = stack[--sp]; } while (0)
+#define JUMP(offset) do { \
+    int16_t target = pc + (int8_t)(offset); \
+    if (target < 0 || target > length) goto fault; \
+    pc = target; \
+  } while (0)
+#define VAR(index) do { index = FETCH(); if (index >= LED_VM_VARS) goto fault; } while (0)
+#define DRAW_COLOR(x, y) (palette ? bars.color((y), (x), 0) : draw_color)
+#define IN_BOUNDS(x, y) ((x) >= 0 && (x) < bars.active_segments && (y) >= 0 && (y) < bars.led_per_segment)
+
+  NEXT();
+
+op_push8:
+  PUSH((int8_t)FETCH());
+  NEXT();
+op_push16:
+  a = FETCH();
+  a |= FETCH() << 8;
+  PUSH(a);
+  NEXT();
+op_load:
+  VAR(a);
+  PUSH(vars[a]);
+  NEXT();
+op_store:
+  VAR(a);
+  POP(vars[a]);
+  NEXT();
+op_dup:
+  POP(a);
+  PUSH(a);
+  PUSH(a);
+  NEXT();
+op_drop:
+  POP(a);
+  NEXT();
+op_swap:
+  POP(b);
+  POP(a);
+  PUSH(b);
+  PUSH(a);
+  NEXT();
+op_add:
+  POP(b);
+  POP(a);
+  PUSH(a + b);
+  NEXT();
+op_sub:
+  POP(b);
+  POP(a);
+  PUSH(a - b);
+  NEXT();
+op_mul:
+  POP(b);
+  POP(a);
+  PUSH(a * b);
+  NEXT();
+op_scale:
+  POP(b);
+  POP(a);
+  PUSH(((int32_t)a * b) >> 8);
+  NEXT();
+op_div:
+  POP(b);
+  POP(a);
+  PUSH(b == 0 ? 0 : a / b);
+  NEXT();
+op_mod:
+  POP(b);
+  POP(a);
+  PUSH(b == 0 ? 0 : a % b);
+  NEXT();
+op_lt:
+  POP(b);
+  POP(a);
+  PUSH(a < b ? 1 : 0);
+  NEXT();
+op_gt:
+  POP(b);
+  POP(a);
+  PUSH(a > b ? 1 : 0);
+  NEXT();
+op_time:
+  PUSH((int16_t)led_time());
+  NEXT();
+op_segments:
+  PUSH(bars.active_segments);
+  NEXT();
+op_leds:
+  PUSH(bars.led_per_segment);
+  NEXT();
+op_sin:
+  POP(a);
+  PUSH(sin8(a));
+  NEXT();
+op_tri:
+  POP(a);
+  a &= 0xFF;
+  PUSH(a < 128 ? a * 2 : (255 - a) * 2);
+  NEXT();
+op_rand:
+  POP(a);
+  PUSH(a > 0 ? bars.particle_rng.below(a) : 0);
+  NEXT();
+op_jmp:
+  a = FETCH();
+  JUMP(a);
+  NEXT();
+op_jz:
+  b = FETCH();
+  POP(a);
+  if (a == 0) {
+    JUMP(b);
+  }
+  NEXT();
+op_loop:
+  VAR(a);
+  b = FETCH();
+  if (--vars[a] > 0) {
+    JUMP(b);
+  }
+  NEXT();
+op_pixel:
+  POP(c);
+  POP(b);
+  POP(a);
+  if (IN_BOUNDS(a, b)) {
+    bars.set_led_color(a, b, DRAW_COLOR(a, b), c);
+  }
+  NEXT();
+op_subpixel:
+  POP(c);
+  POP(b);
+  POP(a);
+  if (IN_BOUNDS(a, (uint16_t)b >> 8)) {
+    bars.set_led_color_subpixel(a, (uint16_t)b, DRAW_COLOR(a, (uint16_t)b >> 8), c);
+  }
+  NEXT();
+op_span:
+  POP(d);
+  POP(c);
+  POP(b);
+  POP(a);
+  // Clip the run to the segment first, a long run off the end would cost a step per led
+  if (b < 0) {
+    c += b;
+    b = 0;
+  }
+  if ((int32_t)c > (int32_t)bars.led_per_segment - b) {
+    c = bars.led_per_segment - b;
+  }
+  if (a >= 0 && a < bars.active_segments) {
+    for (uint16_t y = b; c > 0; y++, c--) {
+      bars.set_led_color(a, y, DRAW_COLOR(a, y), d);
+    }
+  }
+  NEXT();
+op_hue:
+  POP(a);
+  draw_color = bars.from_hue((uint16_t)a, 0);
+  palette = false;
+  NEXT();
+op_palette:
+  palette = true;
+  NEXT();
+op_blend:
+  POP(c);
+  POP(b);
+  POP(a);
+  if (IN_BOUNDS(a, b)) {
+#ifdef LED_INDEXED
+    // Indexed leds only have a level, the led takes the draw color at the blend amount
+    bars.set_led_color(a, b, DRAW_COLOR(a, b), c);
+    NEXT();
+#endif
+    uint16_t n = bars.map_to_position(a, b);
+    uint32_t from = bars.strip.getPixelColor(n);
+    uint32_t to = DRAW_COLOR(a, b);
+    bars.strip.setPixelColor(n,
+      lerp8(from >> 16, to >> 16, c), lerp8(from >> 8, to >> 8, c), lerp8(from, to, c));
+  }
+  NEXT();
+op_spawn:
+  POP(b);
+  POP(a);
+  for (uint8_t i = 0; i < LED_VM_PARTICLES; i++) {
+    if (particles[i].segment == 0xFF) {
+      particles[i].segment = a;
+      particles[i].position = b < 0 ? (bars.led_per_segment - 1) << 8 : 0;
+      particles[i].velocity = b;
+      break;
+    }
+  }
+  NEXT();
+op_move:
+  POP(a);
+  move_particles(bars, a);
+  NEXT();
+
+fault:
+  faults++;
+op_end:
+done:
+  last_steps = steps;
+
+#undef FETCH
+#undef NEXT
+#undef PUSH
+#undef POP
+#undef JUMP
+#undef VAR
+#undef DRAW_COLOR
+#undef IN_BOUNDS
+}
@@ -0,0 +1,135 @@
+/*
+A small stack based bytecode interpreter for patterns that load without reflashing.
+
+A program runs once per frame through the `program` pattern and draws with the same
+functions the built in patterns use, so the selected color, brightness, zones and trails
+all apply. Values are 16 bit, the stack holds `LED_VM_STACK` of them and `LED_VM_VARS`
+variables keep their values from frame to frame. Each frame stops after `LED_VM_BUDGET`
+instructions so a runaway program can't stall rendering.
+
+Programs are loaded from flash, EEPROM or uploaded over any `Stream`, in EEPROM and over
+a stream they are framed the same way:
+
+  0xB7 | length | code... | crc
+
+with `crc` the CRC-8 of the code. The opcodes and their stack effects are
+listed in `vm_opcode`, jump offsets are signed and relative to the next instruction.
+*/
+
+#ifndef led_vm_h
+#define led_vm_h
+
+#include "Arduino.h"
+
+class LED_Bars;
+
+#define LED_VM_START 0xB7
+
+// Largest program in bytes
+#ifndef LED_VM_SIZE
+#define LED_VM_SIZE 96
+#endif
+
+#ifndef LED_VM_STACK
+#define LED_VM_STACK 16
+#endif
+
+#ifndef LED_VM_VARS
+#define LED_VM_VARS 8
+#endif
+
+// Instructions run per frame at most
+#ifndef LED_VM_BUDGET
+#define LED_VM_BUDGET 2048
+#endif
+
+// Particles a program can have moving at once
+#ifndef LED_VM_PARTICLES
+#define LED_VM_PARTICLES 8
+#endif
+
+// EEPROM address of the saved program, clear of the settings ring
+#ifndef LED_VM_EEPROM_ADDR
+#define LED_VM_EEPROM_ADDR 256
+#endif
+
+enum vm_opcode {
+  OP_END,  // stop for this frame
+  OP_PUSH8,  // byte: push a signed byte
+  OP_PUSH16,  // low, high: push a 16 bit value
+  OP_LOAD,  // var: push a variable
+  OP_STORE,  // var: a -> pop into a variable
+  OP_DUP,  // a -> a a
+  OP_DROP,  // a ->
+  OP_SWAP,  // a b -> b a
+  OP_ADD,  // a b -> a + b
+  OP_SUB,  // a b -> a - b
+  OP_MUL,  // a b -> a * b
+  OP_SCALE,  // a b -> a * b / 256
+  OP_DIV,  // a b -> a / b, 0 when b is 0
+  OP_MOD,  // a b -> a % b, 0 when b is 0
+  OP_LT,  // a b -> 1 if a < b else 0
+  OP_GT,  // a b -> 1 if a > b else 0
+  OP_TIME,  // -> animation time in ms, wrapping at 16 bits
+  OP_SEGMENTS,  // -> segments being drawn
+  OP_LEDS,  // -> leds per segment
+  OP_SIN,  // phase -> sine wave 0-255, 256 phase steps per cycle
+  OP_TRI,  // phase -> triangle wave 0-255
+  OP_RAND,  // n -> random value below n
+  OP_JMP,  // offset: jump
+  OP_JZ,  // offset: a -> jump if a is 0
+  OP_LOOP,  // var, offset: decrement a variable and jump while it's above 0
+  OP_PIXEL,  // x y bright -> draw a led
+  OP_SUBPIXEL,  // x y bright -> draw at y in 1/256ths of a led
+  OP_SPAN,  // x y length bright -> draw a run of leds along a segment
+  OP_HUE,  // hue -> draw in a fixed hue until `OP_PALETTE`
+  OP_PALETTE,  // draw in the selected color, the default
+  OP_BLEND,  // x y amount -> move a led toward the draw color, 255 is all the way
+  OP_SPAWN,  // x velocity -> start a particle at the top of a segment, velocity in 1/256 leds per 10ms
+  OP_MOVE,  // bright -> move every particle and draw it, dropping any past the end
+  OP_COUNT,
+};
+
+typedef struct VMParticle {
+  uint8_t segment;
+  // Position in 1/256ths of a led and velocity in 1/256ths of a led per 10ms, segment 0xFF is free
+  uint16_t position;
+  int16_t velocity;
+} vm_particle;
+
+class LED_VM {
+
+private:
+  uint8_t code[LED_VM_SIZE];
+  uint8_t length = 0;
+  int16_t vars[LED_VM_VARS];
+  vm_particle particles[LED_VM_PARTICLES];
+  unsigned long last_move = 0;
+
+  // Upload progress, 0 while waiting for the start byte
+  uint8_t rx_len = 0;
+  uint8_t upload_length = 0;
+
+  void reset();
+  void move_particles(LED_Bars& bars, uint8_t bright);
+
+public:
+  // Frames cut short by the budget and frames stopped by a bad program
+  uint16_t overruns = 0;
+  uint16_t faults = 0;
+  // Instructions run in the last frame
+  uint16_t last_steps = 0;
+
+  LED_VM() {
+    reset();
+  };
+
+  bool load(const uint8_t* program, uint8_t count);
+  bool load_P(const uint8_t* program, uint8_t count);
+  bool load_eeprom(int addr = LED_VM_EEPROM_ADDR);
+  void save_eeprom(int addr = LED_VM_EEPROM_ADDR);
+  bool receive(Stream& source);
+  void run(LED_Bars& bars);
+};
+
+#endif